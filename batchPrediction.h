@@ -0,0 +1,163 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <charconv> // For to_chars
+#include <cmath>    // For fabs
+
+#include "featureMatrix.h"
+#include "streamingEvaluation.h"
+#include "distanceKernels.h"
+#include "gemmDistances.h"
+#include "threadPool.h"
+#include "instrumentation.h"
+
+using namespace std;
+
+// Classifies the rows of a new file with the 1-NN rule against a loaded, normalized training set restricted to a
+// feature subset. Query rows are put through the training set's own normalization (the per-column range
+// normalizeFeatures recorded), read in blocks of PREDICT_BLOCK_ROWS so the file never has to fit in memory, and
+// each block's rows are split across the pool in LOO_ROWS_PER_TASK tiles. Subsets of GEMM_MIN_WIDTH features or
+// more go through the matrix-multiply search, narrower ones through the SIMD column scan; both sum distances in
+// subset order and take the lowest index on ties, so a query equal to a training row gets the label leave-one-out
+// scoring would see. Predictions are written block by block, in file order.
+
+// Query rows read, normalized and classified together
+const size_t PREDICT_BLOCK_ROWS = 16384;
+
+// Largest normalized magnitude a query value may have; further out, squared distances can overflow to infinity
+const double PREDICT_MAX_NORMALIZED = 1e150;
+
+// A training set and subset, prepared once for any number of query blocks
+struct PredictionModel {
+    const FeatureMatrix* training = nullptr;
+    vector<int> features; // 1-based, in the order distances are summed
+    bool useGemm = false;
+    GemmLayout gemm;      // Built only when useGemm
+};
+
+inline PredictionModel buildPredictionModel(const FeatureMatrix& training, const vector<int>& features) {
+    PredictionModel model;
+    model.training = &training;
+    model.features = features;
+    model.useGemm = features.size() >= GEMM_MIN_WIDTH;
+    if (model.useGemm) model.gemm = buildGemmLayout(training, features);
+    return model;
+}
+
+// Normalizes the subset values of one query row (raw `values` in the training file's layout) into `point`, in
+// subset order. False if one is not finite or lies more than PREDICT_MAX_NORMALIZED from the training range.
+inline bool normalizeQuery(const PredictionModel& model, const double* values, double* point) {
+    const FeatureMatrix& training = *model.training;
+    bool inRange = true;
+    for (size_t k = 0; k < model.features.size(); ++k) {
+        size_t f = static_cast<size_t>(model.features[k] - 1);
+        point[k] = normalizeValue(training.minValues[f], training.maxValues[f], values[f]);
+        inRange = inRange && fabs(point[k]) <= PREDICT_MAX_NORMALIZED; // Also false for NaN
+    }
+    return inRange;
+}
+
+// Labels of the nearest training rows to `count` query rows, given row-major in `points` (the subset's normalized
+// values in subset order); -1 when the training set is empty
+inline void predictBlock(const PredictionModel& model, const double* points, size_t count, int* predicted, ThreadPool& pool) {
+    TraceScope trace("predictBlock", "predict");
+    const FeatureMatrix& training = *model.training;
+    size_t width = model.features.size();
+    const DistanceKernels& kernels = distanceKernels();
+
+    pool.parallelForRange(count, LOO_ROWS_PER_TASK, [&](size_t begin, size_t end) {
+        size_t nearest[LOO_ROWS_PER_TASK];
+        double nearestSquared[LOO_ROWS_PER_TASK];
+        for (size_t tileStart = begin; tileStart < end; tileStart += LOO_ROWS_PER_TASK) {
+            size_t tileRows = min(end - tileStart, LOO_ROWS_PER_TASK);
+            const double* tilePoints = points + tileStart * width;
+            if (model.useGemm) {
+                findNearestGemmPoints(model.gemm, training.numRows, tilePoints, tileRows, nearest, nearestSquared);
+            } else {
+                double* distances = scratchRow(training.numRows);
+                for (size_t q = 0; q < tileRows; ++q) {
+                    fill(distances, distances + training.numRows, 0.0);
+                    for (size_t k = 0; k < width; ++k) {
+                        const double* column = training.column(model.features[k] - 1);
+                        kernels.addSquaredColumn(distances, column, tilePoints[q * width + k], distances, training.numRows);
+                    }
+                    nearest[q] = training.numRows == 0 ? 0 : kernels.argmin(distances, training.numRows);
+                }
+                countEvent(Counter::DistanceEvaluations, static_cast<uint64_t>(tileRows) * training.numRows);
+            }
+            for (size_t q = 0; q < tileRows; ++q) {
+                predicted[tileStart + q] = nearest[q] < training.numRows ? training.labels[nearest[q]] : -1;
+            }
+        }
+    });
+    countEvent(Counter::NeighborQueries, count);
+}
+
+// Figures for one prediction run
+struct PredictionReport {
+    size_t numRows = 0;
+    size_t labelMatches = 0;       // Predictions equal to the query file's own label column
+    size_t numBlocks = 0;
+    bool usedGemm = false;
+    double totalMilliseconds = 0.0;  // Reading, normalizing, predicting and writing
+    double searchMilliseconds = 0.0; // Nearest-neighbor search alone
+
+    double queriesPerSecond() const { return totalMilliseconds > 0.0 ? numRows / totalMilliseconds * 1000.0 : 0.0; }
+};
+
+// Predicts every row of `queryFilename` and writes one label per line to `out`. The file has the training
+// file's layout; its first column is only compared against, so unlabeled rows can carry any whole number there.
+inline PredictionReport predictFile(const PredictionModel& model, const string& queryFilename, ostream& out, ThreadPool& pool) {
+    TraceScope trace("predictFile", "predict");
+    auto start = chrono::steady_clock::now();
+    const FeatureMatrix& training = *model.training;
+    size_t width = model.features.size();
+
+    PredictionReport report;
+    report.usedGemm = model.useGemm;
+    vector<double> points(PREDICT_BLOCK_ROWS * width); // Row-major, so a query's subset values are contiguous
+    vector<int> labels(PREDICT_BLOCK_ROWS), predicted(PREDICT_BLOCK_ROWS);
+    string text;
+    size_t blockRows = 0;
+
+    auto flushBlock = [&]() {
+        auto searchStart = chrono::steady_clock::now();
+        predictBlock(model, points.data(), blockRows, predicted.data(), pool);
+        report.searchMilliseconds += chrono::duration<double, milli>(chrono::steady_clock::now() - searchStart).count();
+
+        text.clear();
+        char digits[16];
+        for (size_t r = 0; r < blockRows; ++r) {
+            report.labelMatches += predicted[r] == labels[r];
+            char* stop = to_chars(digits, digits + sizeof(digits), predicted[r]).ptr;
+            text.append(digits, stop);
+            text.push_back('\n');
+        }
+        out.write(text.data(), text.size());
+        report.numRows += blockRows;
+        ++report.numBlocks;
+        blockRows = 0;
+    };
+
+    streamDataset(queryFilename, [&](size_t row, int label, const double* values, size_t numFeatures) {
+        if (numFeatures != training.numFeatures) {
+            cerr << "Error: " << queryFilename << " has " << numFeatures << " features, the training set " << training.numFeatures << endl;
+            exit(1);
+        }
+        if (!normalizeQuery(model, values, &points[blockRows * width])) {
+            cerr << "Error: Row " << row + 1 << " of " << queryFilename << " has a feature value too far outside the training range" << endl;
+            exit(1);
+        }
+        labels[blockRows++] = label;
+        if (blockRows == PREDICT_BLOCK_ROWS) flushBlock();
+        return true;
+    });
+    if (blockRows > 0) flushBlock();
+    out.flush();
+
+    report.totalMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return report;
+}
@@ -0,0 +1,266 @@
+// End-to-end benchmark: times parsing, normalization, one full leave-one-out run and every search strategy
+// on each dataset and prints the results as JSON, so runs can be diffed to catch regressions.
+// Every stage is repeated and reported as median and 95th-percentile wall time, plus distances per second
+// (query-to-row distances the stage computed) and the peak resident set size while it ran.
+// Pair it with datasetGenerator to see how the tool scales from hundreds to millions of rows.
+//
+// Build: g++ -O2 -std=c++17 -pthread benchmark.cpp -o benchmark
+// Usage: ./benchmark [--threads N] [--repeat N] [--nn auto|brute|early|kd|vp|gemm] [--stages LIST]
+//                    [--max-cache-mb N] [--output FILE] [FILE...]
+//        LIST is a comma-separated subset of parse,normalize,loo,forward,backward,bidirectional (default: all).
+//        Searches keep an n x n distance cache, so they are skipped when it would exceed --max-cache-mb.
+//        Without files the bundled small, large and titanic datasets are used.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <sys/resource.h> // For getrusage
+
+#include "featureMatrix.h"
+#include "datasetParser.h"
+#include "threadPool.h"
+#include "distanceKernels.h"
+#include "nearestNeighbor.h"
+#include "subsetMemo.h"
+#include "featureSearch.h"
+#include "searchStrategies.h"
+
+using namespace std;
+
+const char* ALL_STAGES[] = {"parse", "normalize", "loo", "forward", "backward", "bidirectional"};
+
+// Timing summary of one stage on one dataset
+struct StageResult {
+    string name;
+    vector<double> milliseconds; // One entry per repetition
+    double distances = 0.0;      // Query-to-row distances one repetition computes (0 if not meaningful)
+    long peakRssKb = 0;
+    string skipped;              // Reason the stage did not run (empty if it ran)
+};
+
+// Resets the kernel's peak-RSS counter for this process so the next reading covers only what follows
+// (Linux 4.0+; elsewhere the reading is the peak since start-up)
+void resetPeakRss() {
+    ofstream clearRefs("/proc/self/clear_refs");
+    if (clearRefs.is_open()) clearRefs << "5";
+}
+
+// Peak resident set size in KiB: VmHWM from /proc when available, otherwise getrusage
+long readPeakRssKb() {
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) return atol(line.c_str() + 6);
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Nearest-rank percentile of `values` (0 < percentile <= 100)
+double percentile(vector<double> values, double percent) {
+    if (values.empty()) return 0.0;
+    sort(values.begin(), values.end());
+    size_t rank = static_cast<size_t>(percent / 100.0 * values.size() + 0.999999);
+    return values[min(values.size(), max<size_t>(rank, 1)) - 1];
+}
+
+// Independent copy of `source`; FeatureMatrix copies share their column buffer
+FeatureMatrix copyFeatureMatrix(const FeatureMatrix& source) {
+    FeatureMatrix copy = makeFeatureMatrix(source.numRows, source.numFeatures);
+    copy.labels = source.labels;
+    for (size_t f = 0; f < source.numFeatures; ++f) {
+        std::copy(source.column(f), source.column(f) + source.numRows, copy.column(f));
+    }
+    return copy;
+}
+
+// Runs `body` `repeat` times and records each wall time; `body` returns the distances it computed
+StageResult timeStage(const string& name, int repeat, const function<double()>& body) {
+    StageResult result;
+    result.name = name;
+    resetPeakRss();
+    for (int r = 0; r < repeat; ++r) {
+        auto start = chrono::steady_clock::now();
+        result.distances = body();
+        result.milliseconds.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    }
+    result.peakRssKb = readPeakRssKb();
+    return result;
+}
+
+// Quotes `text` as a JSON string, escaping quotes, backslashes and control characters
+string jsonString(const string& text) {
+    string quoted = "\"";
+    for (char c : text) {
+        if (c == '\n') {
+            quoted += "\\n";
+        } else if (c == '\t') {
+            quoted += "\\t";
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned char>(c));
+            quoted += escape;
+        } else {
+            if (c == '"' || c == '\\') quoted += '\\';
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+void writeStageJson(ostream& out, const StageResult& stage) {
+    out << "        {\"name\": " << jsonString(stage.name);
+    if (!stage.skipped.empty()) {
+        out << ", \"skipped\": " << jsonString(stage.skipped) << "}";
+        return;
+    }
+    double median = percentile(stage.milliseconds, 50.0);
+    out << fixed << setprecision(3) << ", \"runs\": " << stage.milliseconds.size() << ", \"median_ms\": " << median
+        << ", \"p95_ms\": " << percentile(stage.milliseconds, 95.0);
+    if (stage.distances > 0.0 && median > 0.0) {
+        out << setprecision(0) << ", \"distances\": " << stage.distances
+            << ", \"distances_per_sec\": " << stage.distances / (median / 1000.0);
+    }
+    out << ", \"peak_rss_kb\": " << stage.peakRssKb << "}";
+}
+
+int main(int argc, char* argv[]) {
+    int numThreads = max(1u, thread::hardware_concurrency());
+    int repeat = 5;
+    double maxCacheMb = 2048.0;
+    NeighborMethod neighborMethod = NeighborMethod::Auto;
+    vector<string> stages(begin(ALL_STAGES), end(ALL_STAGES));
+    string outputPath;
+    vector<string> files;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            numThreads = max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--nn") == 0 && i + 1 < argc && parseNeighborMethod(argv[i + 1], neighborMethod)) {
+            ++i;
+        } else if (strcmp(argv[i], "--max-cache-mb") == 0 && i + 1 < argc) {
+            maxCacheMb = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else if (strcmp(argv[i], "--stages") == 0 && i + 1 < argc) {
+            stages.clear();
+            stringstream list(argv[++i]);
+            string stage;
+            while (getline(list, stage, ',')) {
+                if (find(begin(ALL_STAGES), end(ALL_STAGES), stage) == end(ALL_STAGES)) {
+                    cerr << "Error: Unknown stage " << stage << endl;
+                    return 1;
+                }
+                stages.push_back(stage);
+            }
+        } else if (argv[i][0] == '-') {
+            cerr << "Usage: " << argv[0] << " [--threads N] [--repeat N] [--nn auto|brute|early|kd|vp|gemm] [--stages LIST]"
+                 << " [--max-cache-mb N] [--output FILE] [FILE...]" << endl;
+            return 1;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (files.empty()) files = {"small-test-dataset.txt", "large-test-dataset.txt", "titanic_clean.txt"};
+    auto wanted = [&stages](const char* stage) { return find(stages.begin(), stages.end(), stage) != stages.end(); };
+
+    ThreadPool pool(numThreads);
+    SearchSettings settings;
+    settings.pool = &pool;
+    settings.neighborMethod = neighborMethod;
+
+    ofstream outputFile;
+    if (!outputPath.empty()) {
+        outputFile.open(outputPath);
+        if (!outputFile.is_open()) {
+            cerr << "Error: Unable to open file " << outputPath << endl;
+            return 1;
+        }
+    }
+    ostream& out = outputPath.empty() ? cout : outputFile;
+
+    out << "{\n  \"threads\": " << numThreads << ",\n  \"repeat\": " << repeat << ",\n  \"kernel\": "
+        << jsonString(distanceKernels().name) << ",\n  \"datasets\": [\n";
+
+    for (size_t d = 0; d < files.size(); ++d) {
+        cerr << "Benchmarking " << files[d] << endl;
+        vector<StageResult> results;
+
+        // Parsing always runs once: every later stage needs the data. The binary cache is deliberately bypassed.
+        FeatureMatrix raw;
+        StageResult parse = timeStage("parse", wanted("parse") ? repeat : 1, [&] {
+            raw = FeatureMatrix();
+            parseDataset(files[d], raw, &pool);
+            return 0.0;
+        });
+        if (wanted("parse")) results.push_back(parse);
+
+        FeatureMatrix data = copyFeatureMatrix(raw);
+        normalizeFeatures(data);
+        if (wanted("normalize")) {
+            results.push_back(timeStage("normalize", repeat, [&] {
+                FeatureMatrix copy = copyFeatureMatrix(raw);
+                normalizeFeatures(copy);
+                return 0.0;
+            }));
+        }
+
+        double pairs = static_cast<double>(data.numRows) * (data.numRows - 1); // Distances one full LOO pass computes
+        if (wanted("loo")) {
+            vector<int> allFeatures;
+            for (size_t f = 1; f <= data.numFeatures; ++f) allFeatures.push_back(static_cast<int>(f));
+            results.push_back(timeStage("loo", repeat, [&] {
+                leaveOneOutValidation(data, allFeatures, settings);
+                return pairs;
+            }));
+        }
+
+        // Each search runs the way the interactive program does: traces silenced, a fresh in-memory memo per run.
+        // Every memo miss is one subset scored over all held-out rows, which is what distances counts.
+        double cacheMb = static_cast<double>(data.numRows) * data.numRows * sizeof(double) / (1 << 20);
+        for (int choice = 1; choice <= 3; ++choice) {
+            const char* name = ALL_STAGES[2 + choice];
+            if (!wanted(name)) continue;
+            if (cacheMb > maxCacheMb) {
+                StageResult skipped;
+                skipped.name = name;
+                skipped.skipped = "distance cache would need " + to_string(static_cast<long>(cacheMb)) + " MB";
+                results.push_back(skipped);
+                continue;
+            }
+            results.push_back(timeStage(name, repeat, [&] {
+                SubsetMemo memo;
+                SearchSettings searchSettings = settings;
+                searchSettings.memo = &memo;
+                ostringstream trace;
+                streambuf* console = cout.rdbuf(trace.rdbuf());
+                bool valid;
+                runSearch(data, choice, searchSettings, valid);
+                cout.rdbuf(console);
+                return memo.misses() * pairs;
+            }));
+        }
+
+        out << "    {\n      \"file\": " << jsonString(files[d]) << ",\n      \"rows\": " << data.numRows
+            << ",\n      \"features\": " << data.numFeatures << ",\n      \"stages\": [\n";
+        for (size_t s = 0; s < results.size(); ++s) {
+            writeStageJson(out, results[s]);
+            out << (s + 1 < results.size() ? ",\n" : "\n");
+        }
+        out << "      ]\n    }" << (d + 1 < files.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}" << endl;
+    return 0;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+
+#include "threadPool.h"
+#include "instrumentation.h"
+
+using namespace std;
+
+// Accuracy returned for a candidate whose scoring was abandoned: it was not fully scored and is known to be
+// strictly worse than another candidate of the same step, so it must never be selected, printed as a score
+// or memoized. NaN compares false against everything, so `accuracy > best` skips it on its own.
+const double ABANDONED_ACCURACY = numeric_limits<double>::quiet_NaN();
+
+inline bool isAbandoned(double accuracy) {
+    return std::isnan(accuracy);
+}
+
+// Branch-and-bound state shared by the candidates of one search step.
+// bestCorrect is the highest correct count any fully scored candidate reached. Another candidate is
+// abandoned as soon as correct + remaining < bestCorrect, i.e. once even predicting every remaining held-out
+// row correctly could not reach it. Ties are never abandoned, so the lowest-index rule between equally good
+// candidates still sees every tied score and the selected subsets stay exactly the same.
+struct StepBound {
+    atomic<size_t> bestCorrect{0};
+    atomic<uint64_t> predictionsMade{0};    // Held-out predictions actually computed this step
+    atomic<uint64_t> predictionsSkipped{0}; // Held-out predictions avoided by abandoning candidates
+
+    // Raises bestCorrect to `correct` if that is higher
+    void offer(size_t correct) {
+        size_t current = bestCorrect.load(memory_order_relaxed);
+        while (correct > current && !bestCorrect.compare_exchange_weak(current, correct, memory_order_relaxed)) {
+        }
+    }
+
+    // Same as offer() for a score that came from elsewhere (the subset memo) instead of a bounded evaluation
+    void offerAccuracy(double accuracy, size_t numRows) {
+        if (!isAbandoned(accuracy)) offer(static_cast<size_t>(llround(accuracy * numRows / 100.0)));
+    }
+
+    double skippedFraction() const {
+        uint64_t total = predictionsMade + predictionsSkipped;
+        return total == 0 ? 0.0 : static_cast<double>(predictionsSkipped) / total;
+    }
+};
+
+// Leave-one-out accuracy (in percent) from isCorrect(i) for every held-out row i, split across the pool in
+// LOO_ROWS_PER_TASK chunks. With a bound, every miss is checked against the step's best and the whole
+// candidate stops once it cannot reach it; the result is then ABANDONED_ACCURACY.
+inline double boundedLeaveOneOutAccuracy(ThreadPool& pool, size_t numRows, const function<bool(size_t)>& isCorrect, StepBound* bound) {
+    if (bound == nullptr) {
+        size_t correctPredictions = pool.parallelCount(numRows, isCorrect, LOO_ROWS_PER_TASK);
+        countEvent(Counter::NeighborQueries, numRows);
+        countEvent(Counter::DistanceEvaluations, static_cast<uint64_t>(numRows) * numRows); // One cached row updated per query
+        return static_cast<double>(correctPredictions) / numRows * 100.0;
+    }
+
+    atomic<size_t> misses{0};
+    atomic<bool> abandoned{false};
+    atomic<uint64_t> predicted{0};
+    pool.parallelForRange(numRows, LOO_ROWS_PER_TASK, [&](size_t begin, size_t end) {
+        uint64_t local = 0;
+        for (size_t i = begin; i < end && !abandoned.load(memory_order_relaxed); ++i) {
+            ++local;
+            if (isCorrect(i)) continue;
+            size_t missesSoFar = misses.fetch_add(1, memory_order_relaxed) + 1;
+            if (numRows - missesSoFar < bound->bestCorrect.load(memory_order_relaxed)) {
+                abandoned.store(true, memory_order_relaxed); // correct + remaining can no longer reach the best
+            }
+        }
+        predicted.fetch_add(local, memory_order_relaxed);
+    });
+
+    countEvent(Counter::NeighborQueries, predicted);
+    countEvent(Counter::DistanceEvaluations, predicted * numRows);
+    bound->predictionsMade += predicted;
+    bound->predictionsSkipped += numRows - predicted;
+    if (abandoned) return ABANDONED_ACCURACY;
+
+    size_t correctPredictions = numRows - misses;
+    bound->offer(correctPredictions);
+    return static_cast<double>(correctPredictions) / numRows * 100.0;
+}
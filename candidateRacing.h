@@ -0,0 +1,165 @@
+#pragma once
+
+#include <vector>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "threadPool.h"
+#include "boundedScoring.h"
+#include "instrumentation.h"
+
+using namespace std;
+
+// Racing for the candidates of one search step: every candidate is scored on the same growing random sample
+// of held-out rows, and a candidate is dropped as soon as a confidence interval says it is worse than the
+// leader. Because all candidates see the same rows, the comparison is paired: it only looks at the rows on
+// which the two disagree, which separates candidates far sooner than two independent intervals would.
+// Only the survivors are carried to all n rows, which gives them their exact leave-one-out accuracy.
+// Unlike bounded scoring this can drop the true winner, with a probability the confidence level controls,
+// so it is opt-in.
+
+// Held-out rows in the first racing round; every later round doubles the sample until it covers all rows
+const size_t RACING_FIRST_ROWS = 100;
+
+struct RacingSettings {
+    bool enabled = false;
+    double confidence = 0.95; // Two-sided level of the per-candidate intervals
+    uint64_t seed = 1;        // Seeds the held-out row order, so a race is repeatable whatever the thread count
+};
+
+// z with P(|Z| <= z) = confidence for a standard normal Z, found by bisection on erfc
+inline double normalCriticalValue(double confidence) {
+    double low = 0.0, high = 10.0;
+    for (int iteration = 0; iteration < 100; ++iteration) {
+        double middle = (low + high) / 2.0;
+        if (erfc(middle / sqrt(2.0)) > 1.0 - confidence) low = middle;
+        else high = middle;
+    }
+    return (low + high) / 2.0;
+}
+
+// Shrinks an interval drawn from `sampled` of `numRows` rows without replacement; zero once every row is in
+inline double finitePopulationFactor(size_t sampled, size_t numRows) {
+    return numRows > 1 ? sqrt(static_cast<double>(numRows - sampled) / (numRows - 1)) : 0.0;
+}
+
+// Upper end of the Wilson score interval for `correct` of `sampled` held-out rows out of `numRows`
+inline double racingUpperBound(size_t correct, size_t sampled, size_t numRows, double z) {
+    double m = static_cast<double>(sampled);
+    double p = correct / m;
+    double z2 = z * z;
+    double center = (p + z2 / (2.0 * m)) / (1.0 + z2 / m);
+    double half = z * sqrt(p * (1.0 - p) / m + z2 / (4.0 * m * m)) / (1.0 + z2 / m);
+    return center + half * finitePopulationFactor(sampled, numRows);
+}
+
+// Upper end of the interval for accuracy(candidate) - accuracy(leader) from the sampled rows the candidate
+// alone got right (`wins`) and the leader alone got right (`losses`)
+inline double pairedUpperBound(size_t wins, size_t losses, size_t sampled, size_t numRows, double z) {
+    double m = static_cast<double>(sampled);
+    double mean = (static_cast<double>(wins) - static_cast<double>(losses)) / m;
+    double variance = (wins + losses) / m - mean * mean;
+    if (sampled > 1) variance *= m / (m - 1.0);
+    return mean + z * sqrt(max(variance, 0.0) / m) * finitePopulationFactor(sampled, numRows);
+}
+
+// What a race decided for each candidate of a step
+struct RaceOutcome {
+    vector<double> accuracies;  // Exact accuracy of survivors and already-known candidates, ABANDONED_ACCURACY otherwise
+    vector<size_t> rowsScored;  // Held-out rows each candidate was scored on
+    vector<double> estimates;   // Accuracy on those rows (percent)
+    size_t survivors = 0;       // Candidates scored on every row
+    uint64_t predictionsMade = 0;
+    uint64_t predictionsSkipped = 0;
+};
+
+// Races `numCandidates` candidates over `numRows` held-out rows. predictsCorrectly(c, i) classifies held-out
+// row i with candidate c. known[c] is candidate c's exact accuracy when it is already known (from the memo),
+// NaN otherwise; known candidates take part with a zero-width interval and are never scored again.
+// `stepSeed` picks the row order, shared by all candidates so their samples are paired.
+template <typename PredictsCorrectly>
+RaceOutcome raceCandidates(size_t numCandidates, size_t numRows, const vector<double>& known, const RacingSettings& settings,
+                           uint64_t stepSeed, ThreadPool& pool, PredictsCorrectly predictsCorrectly) {
+    TraceScope trace("raceCandidates", "search");
+    RaceOutcome outcome;
+    outcome.accuracies.assign(numCandidates, ABANDONED_ACCURACY);
+    outcome.rowsScored.assign(numCandidates, 0);
+    outcome.estimates.assign(numCandidates, 0.0);
+
+    vector<size_t> order(numRows);
+    iota(order.begin(), order.end(), 0);
+    mt19937_64 generator(settings.seed * 0x9E3779B97F4A7C15ULL + stepSeed);
+    shuffle(order.begin(), order.end(), generator);
+
+    double z = normalCriticalValue(settings.confidence);
+    vector<size_t> correct(numCandidates, 0);
+    vector<vector<char>> outcomes(numCandidates); // Per sampled row, in sampling order: whether it was classified correctly
+    vector<size_t> alive; // Candidates still being sampled
+    for (size_t c = 0; c < numCandidates; ++c) {
+        if (isAbandoned(known[c])) {
+            alive.push_back(c);
+        } else {
+            outcome.accuracies[c] = known[c];
+            outcome.rowsScored[c] = numRows;
+            outcome.estimates[c] = known[c];
+        }
+    }
+
+    size_t sampled = 0;
+    while (!alive.empty()) {
+        size_t target = sampled == 0 ? min(RACING_FIRST_ROWS, numRows) : min(sampled * 2, numRows);
+        pool.parallelFor(alive.size(), [&](size_t a) {
+            size_t c = alive[a];
+            outcomes[c].resize(target);
+            for (size_t r = sampled; r < target; ++r) {
+                outcomes[c][r] = predictsCorrectly(c, order[r]);
+                correct[c] += outcomes[c][r];
+            }
+        });
+        countEvent(Counter::NeighborQueries, alive.size() * (target - sampled));
+        countEvent(Counter::DistanceEvaluations, static_cast<uint64_t>(alive.size()) * (target - sampled) * numRows);
+        outcome.predictionsMade += alive.size() * (target - sampled);
+        sampled = target;
+        for (size_t c : alive) {
+            outcome.rowsScored[c] = sampled;
+            outcome.estimates[c] = static_cast<double>(correct[c]) / sampled * 100.0;
+        }
+        if (sampled == numRows) break;
+
+        // A candidate is dropped when it is confidently below the best already-known exact score,
+        // or confidently below the sampled leader on the rows where the two disagree
+        double bestKnown = 0.0;
+        for (size_t c = 0; c < numCandidates; ++c) {
+            if (!isAbandoned(known[c])) bestKnown = max(bestKnown, known[c] / 100.0);
+        }
+        size_t leader = alive.front();
+        for (size_t c : alive) {
+            if (correct[c] > correct[leader]) leader = c;
+        }
+        vector<size_t> kept;
+        for (size_t c : alive) {
+            size_t wins = 0, losses = 0;
+            if (c != leader) {
+                for (size_t r = 0; r < sampled; ++r) {
+                    wins += outcomes[c][r] && !outcomes[leader][r];
+                    losses += !outcomes[c][r] && outcomes[leader][r];
+                }
+            }
+            bool belowKnown = racingUpperBound(correct[c], sampled, numRows, z) < bestKnown;
+            bool belowLeader = pairedUpperBound(wins, losses, sampled, numRows, z) < 0.0;
+            if (belowKnown || belowLeader) outcome.predictionsSkipped += numRows - sampled;
+            else kept.push_back(c);
+        }
+        for (size_t c : alive) {
+            if (find(kept.begin(), kept.end(), c) == kept.end()) vector<char>().swap(outcomes[c]); // The leader may be among them
+        }
+        alive.swap(kept);
+    }
+
+    for (size_t c : alive) outcome.accuracies[c] = static_cast<double>(correct[c]) / numRows * 100.0;
+    for (size_t c = 0; c < numCandidates; ++c) outcome.survivors += outcome.rowsScored[c] == numRows && isAbandoned(known[c]);
+    return outcome;
+}
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>    // For memcmp and memcpy
+#include <cstdio>     // For rename and remove
+#include <fcntl.h>    // For open
+#include <sys/mman.h> // For mmap
+#include <sys/stat.h> // For stat
+#include <unistd.h>   // For pread, close and getpid
+
+#include "featureMatrix.h"
+#include "datasetParser.h"
+#include "threadPool.h"
+
+using namespace std;
+
+// Binary cache of a parsed and normalized dataset, written next to the text file as "<file>.cache".
+//
+// Layout (native byte order), every section starting on a COLUMN_ALIGNMENT boundary:
+//   DatasetCacheHeader
+//   int32 labels[numRows]
+//   double minValues[numFeatures], maxValues[numFeatures]  (raw column ranges before normalization)
+//   normalized columns, `stride` values apart (the FeatureMatrix layout, so it can be mapped as is)
+//
+// A cache is used only if it was written from a source file with the same size, modification time and
+// sampled content hash; otherwise the text is parsed again and the cache rewritten.
+
+const char DATASET_CACHE_MAGIC[8] = {'K', 'N', 'N', 'C', 'A', 'C', 'H', 'E'};
+const uint32_t DATASET_CACHE_VERSION = 1;
+const uint32_t DATASET_CACHE_FLOAT64 = 0; // Element type of the column data
+
+// Bytes hashed from each end of the source file; hashing all of it would cost as much as parsing it
+const size_t DATASET_CACHE_HASH_SAMPLE = 1 << 16;
+
+struct DatasetCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dtype;
+    uint64_t numRows;
+    uint64_t numFeatures;
+    uint64_t stride;
+    uint64_t sourceSize;
+    int64_t sourceModifiedNs;
+    uint64_t sourceHash;
+    uint64_t labelsOffset;
+    uint64_t rangesOffset;
+    uint64_t valuesOffset;
+    uint64_t fileSize;
+};
+
+inline string datasetCachePath(const string& filename) {
+    return filename + ".cache";
+}
+
+inline uint64_t alignCacheOffset(uint64_t offset) {
+    return (offset + COLUMN_ALIGNMENT - 1) / COLUMN_ALIGNMENT * COLUMN_ALIGNMENT;
+}
+
+// FNV-1a over `length` bytes, continuing from `hash`
+inline uint64_t fnv1a(const char* bytes, size_t length, uint64_t hash = 14695981039346656037ULL) {
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<unsigned char>(bytes[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Size, modification time and head/tail hash of the source text file; false if it cannot be read
+inline bool fingerprintSource(const string& filename, uint64_t& size, int64_t& modifiedNs, uint64_t& hash) {
+    int descriptor = open(filename.c_str(), O_RDONLY);
+    if (descriptor < 0) return false;
+    struct stat info;
+    bool ok = fstat(descriptor, &info) == 0;
+    if (ok) {
+        size = static_cast<uint64_t>(info.st_size);
+        modifiedNs = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+
+        vector<char> sample(min<uint64_t>(size, DATASET_CACHE_HASH_SAMPLE));
+        ok = pread(descriptor, sample.data(), sample.size(), 0) == static_cast<ssize_t>(sample.size());
+        hash = fnv1a(sample.data(), sample.size());
+        if (ok && size > sample.size()) {
+            ok = pread(descriptor, sample.data(), sample.size(), size - sample.size()) == static_cast<ssize_t>(sample.size());
+            hash = fnv1a(sample.data(), sample.size(), hash);
+        }
+    }
+    close(descriptor);
+    return ok;
+}
+
+// True if the header's sections fit a `length`-byte file the way writeDatasetCache lays them out: in order, on
+// COLUMN_ALIGNMENT boundaries, with whole-cache-line columns at least numRows long. Sizes are bounded by the
+// file length before they are multiplied, so a damaged header cannot overflow the checks.
+inline bool datasetCacheLayoutValid(const DatasetCacheHeader& header, size_t length) {
+    const uint64_t perLine = COLUMN_ALIGNMENT / sizeof(double);
+    if (header.labelsOffset < sizeof(header) || header.labelsOffset > length || header.rangesOffset > length
+        || header.valuesOffset > length) return false;
+    if (header.labelsOffset % COLUMN_ALIGNMENT != 0 || header.rangesOffset % COLUMN_ALIGNMENT != 0
+        || header.valuesOffset % COLUMN_ALIGNMENT != 0) return false;
+    if (header.numRows > length / sizeof(int32_t) || header.numFeatures > length / (2 * sizeof(double))
+        || header.stride > length / sizeof(double)) return false;
+    if (header.stride < max(header.numRows, perLine) || header.stride % perLine != 0) return false;
+    if (header.labelsOffset + header.numRows * sizeof(int32_t) > header.rangesOffset
+        || header.rangesOffset + 2 * header.numFeatures * sizeof(double) > header.valuesOffset) return false;
+    uint64_t columnBytes = header.stride * sizeof(double);
+    return header.numFeatures <= (length - header.valuesOffset) / columnBytes
+        && header.valuesOffset + header.numFeatures * columnBytes == length;
+}
+
+// Maps the cache for `filename` into `matrix` if it is present and current; returns false otherwise.
+// The columns point straight into the mapping (copy-on-write), so nothing is read until it is used.
+inline bool loadDatasetCache(const string& filename, FeatureMatrix& matrix) {
+    uint64_t sourceSize, sourceHash;
+    int64_t sourceModifiedNs;
+    if (!fingerprintSource(filename, sourceSize, sourceModifiedNs, sourceHash)) return false;
+
+    int descriptor = open(datasetCachePath(filename).c_str(), O_RDONLY);
+    if (descriptor < 0) return false;
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    size_t length = 0;
+    if (fstat(descriptor, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(DatasetCacheHeader)) {
+        length = static_cast<size_t>(info.st_size);
+        mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, descriptor, 0);
+    }
+    close(descriptor);
+    if (mapping == MAP_FAILED) return false;
+
+    const char* bytes = static_cast<const char*>(mapping);
+    DatasetCacheHeader header;
+    memcpy(&header, bytes, sizeof(header));
+    bool current = memcmp(header.magic, DATASET_CACHE_MAGIC, sizeof(header.magic)) == 0
+        && header.version == DATASET_CACHE_VERSION && header.dtype == DATASET_CACHE_FLOAT64
+        && header.fileSize == length && header.sourceSize == sourceSize
+        && header.sourceModifiedNs == sourceModifiedNs && header.sourceHash == sourceHash
+        && datasetCacheLayoutValid(header, length);
+    if (!current) {
+        munmap(mapping, length);
+        return false;
+    }
+
+    matrix = FeatureMatrix();
+    matrix.numRows = header.numRows;
+    matrix.numFeatures = header.numFeatures;
+    matrix.stride = header.stride;
+    const int32_t* labels = reinterpret_cast<const int32_t*>(bytes + header.labelsOffset);
+    matrix.labels.assign(labels, labels + header.numRows);
+    const double* ranges = reinterpret_cast<const double*>(bytes + header.rangesOffset);
+    matrix.minValues.assign(ranges, ranges + header.numFeatures);
+    matrix.maxValues.assign(ranges + header.numFeatures, ranges + 2 * header.numFeatures);
+
+    // The matrix owns the mapping: it is released when the last copy of `values` goes away
+    double* values = reinterpret_cast<double*>(static_cast<char*>(mapping) + header.valuesOffset);
+    matrix.values = shared_ptr<double>(values, [mapping, length](double*) { munmap(mapping, length); });
+    return true;
+}
+
+// Writes the normalized `matrix` as the cache for `filename`. The file is written under a temporary name and
+// renamed into place, so a concurrent reader never sees half of it. Returns false (leaving no cache) on failure.
+inline bool writeDatasetCache(const string& filename, const FeatureMatrix& matrix) {
+    DatasetCacheHeader header = {};
+    memcpy(header.magic, DATASET_CACHE_MAGIC, sizeof(header.magic));
+    header.version = DATASET_CACHE_VERSION;
+    header.dtype = DATASET_CACHE_FLOAT64;
+    header.numRows = matrix.numRows;
+    header.numFeatures = matrix.numFeatures;
+    header.stride = matrix.stride;
+    if (!fingerprintSource(filename, header.sourceSize, header.sourceModifiedNs, header.sourceHash)) return false;
+    header.labelsOffset = alignCacheOffset(sizeof(header));
+    header.rangesOffset = alignCacheOffset(header.labelsOffset + matrix.numRows * sizeof(int32_t));
+    header.valuesOffset = alignCacheOffset(header.rangesOffset + 2 * matrix.numFeatures * sizeof(double));
+    header.fileSize = header.valuesOffset + matrix.numFeatures * matrix.stride * sizeof(double);
+
+    string path = datasetCachePath(filename);
+    string temporary = path + "." + to_string(getpid());
+    ofstream file(temporary, ios::binary);
+    if (!file.is_open()) return false;
+
+    auto padTo = [&file](uint64_t offset) {
+        static const char zeros[COLUMN_ALIGNMENT] = {};
+        file.write(zeros, offset - static_cast<uint64_t>(file.tellp()));
+    };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    padTo(header.labelsOffset);
+    vector<int32_t> labels(matrix.labels.begin(), matrix.labels.end());
+    file.write(reinterpret_cast<const char*>(labels.data()), labels.size() * sizeof(int32_t));
+    padTo(header.rangesOffset);
+    file.write(reinterpret_cast<const char*>(matrix.minValues.data()), matrix.numFeatures * sizeof(double));
+    file.write(reinterpret_cast<const char*>(matrix.maxValues.data()), matrix.numFeatures * sizeof(double));
+    padTo(header.valuesOffset);
+    if (matrix.numFeatures > 0) {
+        file.write(reinterpret_cast<const char*>(matrix.column(0)), matrix.numFeatures * matrix.stride * sizeof(double));
+    }
+    file.close();
+
+    if (!file || rename(temporary.c_str(), path.c_str()) != 0) {
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Loads `filename` with every feature normalized to [0, 1]: from its binary cache when that is current,
+// otherwise by parsing and normalizing the text and then writing the cache for next time.
+// Returns true if the cache was used.
+inline bool loadNormalizedDataset(const string& filename, FeatureMatrix& matrix, ThreadPool* pool = nullptr) {
+    TraceScope trace("loadNormalizedDataset", "data");
+    if (loadDatasetCache(filename, matrix)) return true;
+    parseDataset(filename, matrix, pool);
+    normalizeFeatures(matrix);
+    writeDatasetCache(filename, matrix); // Best effort: a read-only directory just means no cache
+    return false;
+}
@@ -0,0 +1,89 @@
+// Synthetic dataset generator for scaling runs, writing the same whitespace format as the bundled datasets:
+// one instance per line, the class label (1 or 2) first and then every feature value.
+// The `relevant` informative features are drawn from a normal distribution whose mean depends on the class;
+// every other feature is pure noise. `noise` is the fraction of labels flipped after the features are drawn,
+// so even the informative subset cannot beat roughly 1 - noise accuracy.
+//
+// Build: g++ -O2 -std=c++17 datasetGenerator.cpp -o datasetGenerator
+// Usage: ./datasetGenerator rows features relevant noise output [seed]
+//        Prints the 1-based indices of the informative features once the file is written.
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+const double CLASS_SEPARATION = 1.5; // Distance between the two class means on an informative feature
+const size_t WRITE_BUFFER_BYTES = 1 << 20;
+
+// Picks which 1-based features carry signal, spread over the whole range instead of the first few columns
+vector<int> chooseRelevantFeatures(int features, int relevant, mt19937_64& generator) {
+    vector<int> all(features);
+    for (int f = 0; f < features; ++f) all[f] = f + 1;
+    shuffle(all.begin(), all.end(), generator);
+    all.resize(relevant);
+    sort(all.begin(), all.end());
+    return all;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 6) {
+        cerr << "Usage: " << argv[0] << " rows features relevant noise output [seed]" << endl;
+        return 1;
+    }
+    long long rows = atoll(argv[1]);
+    int features = atoi(argv[2]);
+    int relevant = atoi(argv[3]);
+    double noise = atof(argv[4]);
+    string output = argv[5];
+    unsigned long long seed = argc > 6 ? strtoull(argv[6], nullptr, 10) : 42;
+
+    if (rows < 2 || features < 1 || relevant < 0 || relevant > features || noise < 0.0 || noise > 1.0) {
+        cerr << "Error: Need rows >= 2, features >= 1, 0 <= relevant <= features and 0 <= noise <= 1" << endl;
+        return 1;
+    }
+
+    FILE* file = fopen(output.c_str(), "w");
+    if (file == nullptr) {
+        cerr << "Error: Unable to open file " << output << endl;
+        return 1;
+    }
+    vector<char> buffer(WRITE_BUFFER_BYTES);
+    setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+
+    mt19937_64 generator(seed);
+    vector<int> relevantFeatures = chooseRelevantFeatures(features, relevant, generator);
+    vector<bool> informative(features + 1, false);
+    for (int feature : relevantFeatures) informative[feature] = true;
+
+    bernoulli_distribution secondClass(0.5);
+    bernoulli_distribution flipLabel(noise);
+    normal_distribution<double> normal(0.0, 1.0);
+
+    for (long long row = 0; row < rows; ++row) {
+        int label = secondClass(generator) ? 2 : 1;
+        double mean = label == 2 ? CLASS_SEPARATION : 0.0;
+        int written = flipLabel(generator) ? 3 - label : label; // Class noise only touches the written label
+
+        fprintf(file, "  %.7e", static_cast<double>(written));
+        for (int f = 1; f <= features; ++f) {
+            fprintf(file, "  %.7e", normal(generator) + (informative[f] ? mean : 0.0));
+        }
+        fputc('\n', file);
+    }
+
+    if (fclose(file) != 0) {
+        cerr << "Error: Unable to write file " << output << endl;
+        return 1;
+    }
+
+    cout << "Wrote " << rows << " rows x " << features << " features to " << output << ", informative features {";
+    for (size_t i = 0; i < relevantFeatures.size(); ++i) cout << (i ? "," : "") << relevantFeatures[i];
+    cout << "}" << endl;
+    return 0;
+}
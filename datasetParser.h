@@ -0,0 +1,268 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>      // For memchr
+#include <charconv>     // For from_chars
+#include <cmath>        // For floor and isfinite
+#include <climits>      // For INT_MIN and INT_MAX
+#include <fcntl.h>      // For open
+#include <sys/mman.h>   // For mmap
+#include <sys/stat.h>   // For fstat
+#include <unistd.h>     // For close
+
+#include "featureMatrix.h"
+#include "threadPool.h"
+
+using namespace std;
+
+// Files smaller than this are parsed on the calling thread; splitting them costs more than it saves
+const size_t PARSE_PARALLEL_MIN_BYTES = 1 << 20;
+
+// Chunks handed to each pool thread, so a chunk full of long lines does not hold up the others
+const size_t PARSE_CHUNKS_PER_THREAD = 4;
+
+// Read-only memory mapping of a whole file, unmapped when it goes out of scope
+class MappedFile {
+public:
+    explicit MappedFile(const string& filename) {
+        int descriptor = open(filename.c_str(), O_RDONLY);
+        if (descriptor < 0) return;
+        struct stat info;
+        if (fstat(descriptor, &info) == 0) {
+            opened = true;
+            length = static_cast<size_t>(info.st_size);
+            if (length > 0) {
+                void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+                if (mapping == MAP_FAILED) {
+                    opened = false;
+                    length = 0;
+                } else {
+                    bytes = static_cast<const char*>(mapping);
+                    madvise(mapping, length, MADV_SEQUENTIAL);
+                }
+            }
+        }
+        close(descriptor); // The mapping stays valid after the descriptor is closed
+    }
+
+    ~MappedFile() {
+        if (bytes != nullptr) munmap(const_cast<char*>(bytes), length);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const { return opened; }
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+    bool opened = false;
+};
+
+// A run of whole lines parsed by one task
+struct ParseChunk {
+    const char* begin;
+    const char* end;
+    size_t firstLine = 0; // 1-based file line number of the chunk's first line
+    size_t numLines = 0;
+    size_t firstRow = 0;  // Matrix row of the chunk's first non-blank line
+    size_t numRows = 0;
+
+    size_t errorLine = 0; // 0 if every line parsed
+    string error;
+};
+
+// Field separators; '\r' covers files with CRLF line endings
+inline bool isFieldSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// End of the line starting at `p` (the newline itself, or `end`)
+inline const char* lineEnd(const char* p, const char* end) {
+    const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+    return newline != nullptr ? newline : end;
+}
+
+// True if [p, end) holds nothing but separators
+inline bool isBlankLine(const char* p, const char* end) {
+    while (p < end && isFieldSpace(*p)) ++p;
+    return p == end;
+}
+
+// Parses the next whitespace-separated number in [p, end) and advances `p` past it.
+// Returns false at the end of the line; sets `malformed` if the next field is not a number.
+inline bool nextField(const char*& p, const char* end, double& value, bool& malformed) {
+    while (p < end && isFieldSpace(*p)) ++p;
+    if (p == end) return false;
+    const char* start = p;
+    if (*start == '+') ++start; // from_chars does not accept a leading plus sign
+    from_chars_result result = from_chars(start, end, value);
+    if (result.ec != errc() || (result.ptr < end && !isFieldSpace(*result.ptr))) {
+        malformed = true;
+        return false;
+    }
+    p = result.ptr;
+    return true;
+}
+
+// Splits the mapping into about `count` chunks that each end on a line boundary
+inline vector<ParseChunk> splitIntoChunks(const char* data, size_t size, size_t count) {
+    vector<ParseChunk> chunks;
+    const char* end = data + size;
+    const char* p = data;
+    for (size_t c = 0; c < count && p < end; ++c) {
+        const char* target = data + size * (c + 1) / count;
+        const char* stop = target <= p ? p : target;
+        stop = c + 1 == count ? end : lineEnd(stop, end);
+        if (stop < end) ++stop; // Keep the newline with its line
+        ParseChunk chunk;
+        chunk.begin = p;
+        chunk.end = stop;
+        chunks.push_back(chunk);
+        p = stop;
+    }
+    return chunks;
+}
+
+// First pass over a chunk: counts its lines and its non-blank (data) lines
+inline void countChunkLines(ParseChunk& chunk) {
+    for (const char* p = chunk.begin; p < chunk.end;) {
+        const char* stop = lineEnd(p, chunk.end);
+        ++chunk.numLines;
+        if (!isBlankLine(p, stop)) ++chunk.numRows;
+        p = stop + (stop < chunk.end); // Step over the newline
+    }
+}
+
+// Parses one non-blank data line in [p, stop): the class label into `label`, then every feature value through
+// store(index, value). Returns false with `error` set if a field is not a number, a value is infinite or NaN,
+// or the label is not a whole number that fits an int; `numValues` is how many feature values the line held.
+template <typename Store>
+inline bool parseDataLine(const char* p, const char* stop, int& label, size_t& numValues, string& error, Store store) {
+    double value;
+    bool malformed = false;
+    nextField(p, stop, value, malformed);
+    if (malformed) {
+        error = "has a field that is not a number";
+        return false;
+    }
+    if (!isfinite(value) || value != floor(value) || value < INT_MIN || value > INT_MAX) {
+        error = "has a class label that is not a whole number in the int range";
+        return false;
+    }
+    label = static_cast<int>(value);
+
+    numValues = 0;
+    while (nextField(p, stop, value, malformed)) {
+        if (!isfinite(value)) {
+            error = "has a feature value that is infinite or NaN";
+            return false;
+        }
+        store(numValues++, value);
+    }
+    if (malformed) {
+        error = "has a field that is not a number";
+        return false;
+    }
+    return true;
+}
+
+// Second pass over a chunk: parses each data line straight into the matrix columns.
+// Stops at the first malformed line and records it in the chunk.
+inline void parseChunkRows(ParseChunk& chunk, FeatureMatrix& matrix) {
+    size_t row = chunk.firstRow;
+    size_t lineNumber = chunk.firstLine;
+    for (const char* p = chunk.begin; p < chunk.end; ++lineNumber) {
+        const char* stop = lineEnd(p, chunk.end);
+        const char* next = stop + (stop < chunk.end);
+        if (isBlankLine(p, stop)) {
+            p = next;
+            continue;
+        }
+
+        size_t numValues;
+        bool parsed = parseDataLine(p, stop, matrix.labels[row], numValues, chunk.error, [&](size_t feature, double value) {
+            if (feature < matrix.numFeatures) matrix.at(row, feature) = value;
+        });
+        if (!parsed) {
+            chunk.errorLine = lineNumber;
+            return;
+        }
+        if (numValues != matrix.numFeatures) {
+            chunk.errorLine = lineNumber;
+            chunk.error = "has " + to_string(numValues) + " features, expected " + to_string(matrix.numFeatures);
+            return;
+        }
+        ++row;
+        p = next;
+    }
+}
+
+// Reads the dataset file into a feature matrix.
+// The first column is treated as the label, and the rest are feature values.
+// The file is memory-mapped and parsed in two passes: the first counts lines so the matrix can be allocated
+// once at its final size, the second parses numbers with from_chars directly into the columns. With a pool,
+// large files are split at line boundaries and both passes run in parallel. Blank lines are skipped; any
+// other line that does not match the first line's width is reported with its line number.
+inline void parseDataset(const string& filename, FeatureMatrix& matrix, ThreadPool* pool = nullptr) {
+    TraceScope trace("parseDataset", "data");
+    MappedFile file(filename);
+    if (!file.isOpen()) { // Check if file opens successfully
+        cerr << "Error: Unable to open file " << filename << endl;
+        exit(1); // Exit if file cannot be opened
+    }
+
+    size_t numChunks = 1;
+    if (pool != nullptr && file.size() >= PARSE_PARALLEL_MIN_BYTES) numChunks = pool->size() * PARSE_CHUNKS_PER_THREAD;
+    vector<ParseChunk> chunks = splitIntoChunks(file.data(), file.size(), numChunks);
+
+    auto forEachChunk = [&](const function<void(ParseChunk&)>& body) {
+        if (pool == nullptr || chunks.size() == 1) {
+            for (auto& chunk : chunks) body(chunk);
+        } else {
+            pool->parallelFor(chunks.size(), [&](size_t c) { body(chunks[c]); });
+        }
+    };
+
+    // Pass 1: line counts give every chunk its first line number and first matrix row
+    forEachChunk(countChunkLines);
+    size_t numLines = 0, numRows = 0;
+    for (auto& chunk : chunks) {
+        chunk.firstLine = numLines + 1;
+        chunk.firstRow = numRows;
+        numLines += chunk.numLines;
+        numRows += chunk.numRows;
+    }
+
+    // The first data line fixes the number of features
+    size_t numFeatures = 0;
+    const char* end = file.data() + file.size();
+    for (const char* p = file.data(); numRows > 0 && p < end;) {
+        const char* stop = lineEnd(p, end);
+        if (!isBlankLine(p, stop)) {
+            double value;
+            bool malformed = false;
+            size_t numFields = 0;
+            while (nextField(p, stop, value, malformed)) ++numFields;
+            numFeatures = numFields > 0 ? numFields - 1 : 0; // A malformed line is reported by pass 2
+            break;
+        }
+        p = stop + (stop < end);
+    }
+
+    // Pass 2: parse into the pre-sized matrix
+    matrix = makeFeatureMatrix(numRows, numFeatures);
+    forEachChunk([&matrix](ParseChunk& chunk) { parseChunkRows(chunk, matrix); });
+
+    for (const auto& chunk : chunks) { // Chunks are in file order, so this is the first bad line
+        if (chunk.errorLine != 0) {
+            cerr << "Error: Line " << chunk.errorLine << " of " << filename << " " << chunk.error << endl;
+            exit(1);
+        }
+    }
+}
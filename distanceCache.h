@@ -0,0 +1,217 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include "featureMatrix.h"
+#include "threadPool.h"
+#include "boundedScoring.h"
+#include "distanceKernels.h"
+#include "kNearestNeighbors.h"
+
+using namespace std;
+
+// Subtractions allowed before the partial sums are recomputed from scratch to shed rounding drift
+const int CACHE_REBUILD_INTERVAL = 8;
+
+// Cached distances this close to the best are treated as possible ties and recomputed exactly.
+// Features are normalized to [0, 1], so rounding error in a sum stays many orders of magnitude below this.
+const double CACHE_TIE_TOLERANCE = 1e-9;
+
+// n x n matrix of accumulated squared distances for a committed feature subset.
+// Extending or shrinking the subset by one feature only needs that column's squared differences
+// added or subtracted, so a candidate can be scored in O(n^2) no matter how wide the subset is.
+// The matrix takes n^2 doubles, so the searches only keep one while it fits SearchSettings::maxCacheBytes.
+struct DistanceCache {
+    size_t numRows = 0;
+    vector<int> features;            // Committed 1-based features, in the order they were added
+    vector<double> squaredDistances; // Row-major numRows x numRows partial sums
+    int subtractionsSinceRebuild = 0; // Removals applied since the sums were last recomputed
+};
+
+// Adds column `feature` (1-based) into the cached partial sums and records it as committed
+inline void addFeatureToCache(DistanceCache& cache, const FeatureMatrix& data, int feature) {
+    const double* column = data.column(feature - 1); // Convert 1-based index to 0-based
+    const DistanceKernels& kernels = distanceKernels();
+    for (size_t i = 0; i < cache.numRows; ++i) {
+        double* row = &cache.squaredDistances[i * cache.numRows];
+        kernels.addSquaredColumn(row, column, column[i], row, cache.numRows);
+    }
+    cache.features.push_back(feature);
+}
+
+// Rebuilds the cache from scratch for `features`, summing columns in the given order
+inline void buildDistanceCache(DistanceCache& cache, const FeatureMatrix& data, const vector<int>& features) {
+    cache.numRows = data.numRows;
+    cache.features.clear();
+    cache.squaredDistances.assign(data.numRows * data.numRows, 0.0);
+    countEvent(Counter::Allocations);
+    cache.subtractionsSinceRebuild = 0;
+    for (int feature : features) {
+        addFeatureToCache(cache, data, feature);
+    }
+}
+
+// Subtracts column `feature` (1-based) out of the cached partial sums and drops it from the committed set.
+// Every CACHE_REBUILD_INTERVAL removals the remaining columns are summed again from scratch, so
+// cancellation error never accumulates across a long backward search.
+inline void removeFeatureFromCache(DistanceCache& cache, const FeatureMatrix& data, int feature) {
+    auto committed = find(cache.features.begin(), cache.features.end(), feature);
+    if (committed == cache.features.end()) return; // Not in the sums (bidirectional search adds features the backward side already dropped)
+    cache.features.erase(committed);
+
+    if (++cache.subtractionsSinceRebuild >= CACHE_REBUILD_INTERVAL) {
+        vector<int> remaining = cache.features;
+        buildDistanceCache(cache, data, remaining);
+        return;
+    }
+
+    const double* column = data.column(feature - 1);
+    const DistanceKernels& kernels = distanceKernels();
+    for (size_t i = 0; i < cache.numRows; ++i) {
+        double* row = &cache.squaredDistances[i * cache.numRows];
+        kernels.subtractSquaredColumn(row, column, column[i], row, cache.numRows);
+    }
+}
+
+// Whether held-out row i is classified correctly by the committed subset extended by `feature` (1-based).
+// Each pair's squared distance is the cached partial sum plus one column's squared difference.
+// With `vote.k` above 1 the k nearest rows vote instead of argmin picking one.
+inline bool additionPredictsCorrectly(const DistanceCache& cache, const FeatureMatrix& data, int feature, size_t i, const NeighborVote& vote) {
+    const double* column = data.column(feature - 1);
+    const DistanceKernels& kernels = distanceKernels();
+    const double* row = &cache.squaredDistances[i * cache.numRows];
+    double* distances = scratchRow(cache.numRows);
+
+    kernels.addSquaredColumn(row, column, column[i], distances, cache.numRows);
+    if (!vote.isOneNearest()) return predictByVote(distances, cache.numRows, i, data.labels, vote) == data.labels[i];
+    excludeRow(distances, i); // Leave out the test instance
+    size_t nearest = kernels.argmin(distances, cache.numRows);
+
+    int predictedLabel = nearest == i ? -1 : data.labels[nearest];
+    return predictedLabel == data.labels[i];
+}
+
+// Leave-one-out accuracy of the committed subset extended by `feature` (1-based).
+// Held-out rows are split across the pool in LOO_ROWS_PER_TASK chunks; with a bound, the candidate is
+// abandoned (ABANDONED_ACCURACY) once it can no longer reach the best score of its step.
+inline double evaluateFeatureAddition(const DistanceCache& cache, const FeatureMatrix& data, int feature, ThreadPool& pool, StepBound* bound = nullptr,
+                                      const NeighborVote& vote = NeighborVote()) {
+    return boundedLeaveOneOutAccuracy(pool, cache.numRows, [&](size_t i) {
+        return additionPredictsCorrectly(cache, data, feature, i, vote);
+    }, bound);
+}
+
+// Leave-one-out accuracy of the committed subset with `feature` (1-based) taken out.
+// Each pair's squared distance is the cached full sum minus one column's squared difference. Subtraction
+// rounds differently from summing the remaining columns, which matters on datasets full of exact ties,
+// so neighbors within CACHE_TIE_TOLERANCE of the best are re-summed directly before one is picked.
+// Held-out rows are split across the pool in LOO_ROWS_PER_TASK chunks; with a bound, the candidate is
+// abandoned (ABANDONED_ACCURACY) once it can no longer reach the best score of its step.
+// With `vote.k` above 1 the same re-summing covers every row near the k-th nearest before the k nearest vote.
+inline double evaluateFeatureRemoval(const DistanceCache& cache, const FeatureMatrix& data, int feature, ThreadPool& pool, StepBound* bound = nullptr,
+                                     const NeighborVote& vote = NeighborVote()) {
+    const double* column = data.column(feature - 1);
+    vector<const double*> remainingColumns; // Columns of the reduced subset, in committed order
+    for (int committed : cache.features) {
+        if (committed != feature) remainingColumns.push_back(data.column(committed - 1));
+    }
+
+    const DistanceKernels& kernels = distanceKernels();
+
+    return boundedLeaveOneOutAccuracy(pool, cache.numRows, [&](size_t i) {
+        const double* row = &cache.squaredDistances[i * cache.numRows];
+        double* distances = scratchRow(cache.numRows);
+
+        // First pass: smallest distance according to the subtracted sums
+        kernels.subtractSquaredColumn(row, column, column[i], distances, cache.numRows);
+        if (!vote.isOneNearest()) {
+            int predictedLabel = predictByVoteRechecked(distances, cache.numRows, i, data.labels, vote, CACHE_TIE_TOLERANCE, [&](size_t j) {
+                double distance = 0.0;
+                for (const double* remaining : remainingColumns) {
+                    double diff = remaining[i] - remaining[j];
+                    distance += diff * diff;
+                }
+                return distance;
+            });
+            return predictedLabel == data.labels[i];
+        }
+        excludeRow(distances, i); // Leave out the test instance
+        double approximateMin = distances[kernels.argmin(distances, cache.numRows)];
+
+        // Second pass: only rows that could be the nearest neighbor are summed exactly
+        double minDistance = numeric_limits<double>::max();
+        int predictedLabel = -1;
+
+        for (size_t j = 0; j < cache.numRows; ++j) {
+            if (distances[j] > approximateMin + CACHE_TIE_TOLERANCE) continue; // Also skips the excluded row
+
+            double distance = 0.0;
+            for (const double* remaining : remainingColumns) {
+                double diff = remaining[i] - remaining[j];
+                distance += diff * diff;
+            }
+            if (distance < minDistance) {
+                minDistance = distance;
+                predictedLabel = data.labels[j];
+            }
+        }
+
+        return predictedLabel == data.labels[i];
+    }, bound);
+}
+
+// Adds column `feature` (1-based) into cached row i only, or subtracts it; the caller records the change in
+// cache.features once every row is updated. Lets a caller score each row right after updating it.
+inline void updateCachedRow(DistanceCache& cache, const FeatureMatrix& data, int feature, size_t i, bool add) {
+    const double* column = data.column(feature - 1);
+    double* row = &cache.squaredDistances[i * cache.numRows];
+    if (add) distanceKernels().addSquaredColumn(row, column, column[i], row, cache.numRows);
+    else distanceKernels().subtractSquaredColumn(row, column, column[i], row, cache.numRows);
+}
+
+// Whether held-out row i is classified correctly by exactly the committed subset. The sums may have been through
+// any number of additions and subtractions, so rows within CACHE_TIE_TOLERANCE of the best are re-summed over
+// `columns` (the subset's columns, in the order a direct leave-one-out would sum them) before one is picked.
+inline bool cachedSubsetPredictsCorrectly(const DistanceCache& cache, const FeatureMatrix& data, const vector<const double*>& columns, size_t i,
+                                          const NeighborVote& vote) {
+    const DistanceKernels& kernels = distanceKernels();
+    const double* row = &cache.squaredDistances[i * cache.numRows];
+    auto exactDistance = [&](size_t j) {
+        double distance = 0.0;
+        for (const double* column : columns) {
+            double diff = column[i] - column[j];
+            distance += diff * diff;
+        }
+        return distance;
+    };
+    if (!vote.isOneNearest()) {
+        return predictByVoteRechecked(row, cache.numRows, i, data.labels, vote, CACHE_TIE_TOLERANCE, exactDistance) == data.labels[i];
+    }
+
+    // Nearest cached row on either side of the held-out row, so the shared row is never written
+    size_t nearest = i;
+    if (i > 0) nearest = kernels.argmin(row, i);
+    if (i + 1 < cache.numRows) {
+        size_t right = i + 1 + kernels.argmin(row + i + 1, cache.numRows - i - 1);
+        if (nearest == i || row[right] < row[nearest]) nearest = right;
+    }
+    if (nearest == i) return data.labels[i] == -1; // A single row has no neighbor
+
+    // Usually no other row is within the tolerance (the held-out row's own zero aside), and nothing is re-summed
+    double bound = row[nearest] + CACHE_TIE_TOLERANCE;
+    if (kernels.countAtMost(row, cache.numRows, bound) - (row[i] <= bound) == 1) return data.labels[nearest] == data.labels[i];
+
+    double minDistance = numeric_limits<double>::max();
+    int predictedLabel = -1;
+    for (size_t j = 0; j < cache.numRows; ++j) {
+        if (j == i || row[j] > bound) continue;
+        double distance = exactDistance(j);
+        if (distance < minDistance) {
+            minDistance = distance;
+            predictedLabel = data.labels[j];
+        }
+    }
+    return predictedLabel == data.labels[i];
+}
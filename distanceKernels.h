@@ -0,0 +1,256 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <cstddef>
+#include <immintrin.h> // SSE2 / AVX2 / AVX-512 intrinsics
+
+#include "instrumentation.h"
+
+using namespace std;
+
+// Squared-distance kernels over feature columns.
+// Nearest-neighbor loops only need the argmin, so distances stay squared and no sqrt is taken.
+// Each kernel works lane by lane with a separate multiply and add (never a fused multiply-add),
+// so every variant produces bit-for-bit the same sums as the scalar loop.
+struct DistanceKernels {
+    const char* name;
+    // out[j] = base[j] + (testValue - column[j])^2; `base` may be the same array as `out`
+    void (*addSquaredColumn)(const double* base, const double* column, double testValue, double* out, size_t n);
+    // out[j] = base[j] - (testValue - column[j])^2; `base` may be the same array as `out`
+    void (*subtractSquaredColumn)(const double* base, const double* column, double testValue, double* out, size_t n);
+    // Index of the first smallest value in values[0, n)
+    size_t (*argmin)(const double* values, size_t n);
+    // How many of values[0, n) are <= bound (finds near-ties to the minimum)
+    size_t (*countAtMost)(const double* values, size_t n, double bound);
+};
+
+// ---------------- Scalar ----------------
+
+__attribute__((optimize("fp-contract=off")))
+inline void addSquaredColumnScalar(const double* base, const double* column, double testValue, double* out, size_t n) {
+    for (size_t j = 0; j < n; ++j) {
+        double diff = testValue - column[j];
+        out[j] = base[j] + diff * diff;
+    }
+}
+
+__attribute__((optimize("fp-contract=off")))
+inline void subtractSquaredColumnScalar(const double* base, const double* column, double testValue, double* out, size_t n) {
+    for (size_t j = 0; j < n; ++j) {
+        double diff = testValue - column[j];
+        out[j] = base[j] - diff * diff;
+    }
+}
+
+inline size_t argminScalar(const double* values, size_t n) {
+    size_t best = 0;
+    for (size_t j = 1; j < n; ++j) {
+        if (values[j] < values[best]) best = j;
+    }
+    return best;
+}
+
+inline size_t countAtMostScalar(const double* values, size_t n, double bound) {
+    size_t count = 0;
+    for (size_t j = 0; j < n; ++j) count += values[j] <= bound;
+    return count;
+}
+
+// Scans for the first index holding `target` (used after a vector min reduction)
+inline size_t firstIndexOf(const double* values, size_t n, double target) {
+    for (size_t j = 0; j < n; ++j) {
+        if (values[j] == target) return j;
+    }
+    return 0;
+}
+
+// ---------------- SSE2 (2 lanes) ----------------
+
+__attribute__((target("sse2"), optimize("fp-contract=off")))
+inline void addSquaredColumnSse2(const double* base, const double* column, double testValue, double* out, size_t n) {
+    __m128d test = _mm_set1_pd(testValue);
+    size_t j = 0;
+    for (; j + 2 <= n; j += 2) {
+        __m128d diff = _mm_sub_pd(test, _mm_loadu_pd(column + j));
+        _mm_storeu_pd(out + j, _mm_add_pd(_mm_loadu_pd(base + j), _mm_mul_pd(diff, diff)));
+    }
+    addSquaredColumnScalar(base + j, column + j, testValue, out + j, n - j);
+}
+
+__attribute__((target("sse2"), optimize("fp-contract=off")))
+inline void subtractSquaredColumnSse2(const double* base, const double* column, double testValue, double* out, size_t n) {
+    __m128d test = _mm_set1_pd(testValue);
+    size_t j = 0;
+    for (; j + 2 <= n; j += 2) {
+        __m128d diff = _mm_sub_pd(test, _mm_loadu_pd(column + j));
+        _mm_storeu_pd(out + j, _mm_sub_pd(_mm_loadu_pd(base + j), _mm_mul_pd(diff, diff)));
+    }
+    subtractSquaredColumnScalar(base + j, column + j, testValue, out + j, n - j);
+}
+
+__attribute__((target("sse2")))
+inline size_t argminSse2(const double* values, size_t n) {
+    if (n < 4) return argminScalar(values, n);
+    __m128d best = _mm_loadu_pd(values);
+    size_t j = 2;
+    for (; j + 2 <= n; j += 2) best = _mm_min_pd(best, _mm_loadu_pd(values + j));
+    double lanes[2];
+    _mm_storeu_pd(lanes, best);
+    double minimum = lanes[0] < lanes[1] ? lanes[0] : lanes[1];
+    for (; j < n; ++j) minimum = values[j] < minimum ? values[j] : minimum;
+    return firstIndexOf(values, n, minimum);
+}
+
+__attribute__((target("sse2")))
+inline size_t countAtMostSse2(const double* values, size_t n, double bound) {
+    __m128d limit = _mm_set1_pd(bound);
+    size_t count = 0, j = 0;
+    for (; j + 2 <= n; j += 2) count += __builtin_popcount(_mm_movemask_pd(_mm_cmple_pd(_mm_loadu_pd(values + j), limit)));
+    return count + countAtMostScalar(values + j, n - j, bound);
+}
+
+// ---------------- AVX2 (4 lanes) ----------------
+
+__attribute__((target("avx2"), optimize("fp-contract=off")))
+inline void addSquaredColumnAvx2(const double* base, const double* column, double testValue, double* out, size_t n) {
+    __m256d test = _mm256_set1_pd(testValue);
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4) {
+        __m256d diff = _mm256_sub_pd(test, _mm256_loadu_pd(column + j));
+        _mm256_storeu_pd(out + j, _mm256_add_pd(_mm256_loadu_pd(base + j), _mm256_mul_pd(diff, diff)));
+    }
+    addSquaredColumnScalar(base + j, column + j, testValue, out + j, n - j);
+}
+
+__attribute__((target("avx2"), optimize("fp-contract=off")))
+inline void subtractSquaredColumnAvx2(const double* base, const double* column, double testValue, double* out, size_t n) {
+    __m256d test = _mm256_set1_pd(testValue);
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4) {
+        __m256d diff = _mm256_sub_pd(test, _mm256_loadu_pd(column + j));
+        _mm256_storeu_pd(out + j, _mm256_sub_pd(_mm256_loadu_pd(base + j), _mm256_mul_pd(diff, diff)));
+    }
+    subtractSquaredColumnScalar(base + j, column + j, testValue, out + j, n - j);
+}
+
+__attribute__((target("avx2")))
+inline size_t argminAvx2(const double* values, size_t n) {
+    if (n < 8) return argminScalar(values, n);
+    __m256d best = _mm256_loadu_pd(values);
+    size_t j = 4;
+    for (; j + 4 <= n; j += 4) best = _mm256_min_pd(best, _mm256_loadu_pd(values + j));
+    double lanes[4];
+    _mm256_storeu_pd(lanes, best);
+    double minimum = lanes[0];
+    for (double lane : lanes) minimum = lane < minimum ? lane : minimum;
+    for (; j < n; ++j) minimum = values[j] < minimum ? values[j] : minimum;
+
+    // Locate the first lane holding the minimum, four at a time
+    __m256d target = _mm256_set1_pd(minimum);
+    for (j = 0; j + 4 <= n; j += 4) {
+        int mask = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(values + j), target, _CMP_EQ_OQ));
+        if (mask != 0) return j + __builtin_ctz(mask);
+    }
+    return j + firstIndexOf(values + j, n - j, minimum);
+}
+
+__attribute__((target("avx2")))
+inline size_t countAtMostAvx2(const double* values, size_t n, double bound) {
+    __m256d limit = _mm256_set1_pd(bound);
+    size_t count = 0, j = 0;
+    for (; j + 4 <= n; j += 4) count += __builtin_popcount(_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(values + j), limit, _CMP_LE_OQ)));
+    return count + countAtMostScalar(values + j, n - j, bound);
+}
+
+// ---------------- AVX-512 (8 lanes) ----------------
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+inline void addSquaredColumnAvx512(const double* base, const double* column, double testValue, double* out, size_t n) {
+    __m512d test = _mm512_set1_pd(testValue);
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8) {
+        __m512d diff = _mm512_sub_pd(test, _mm512_loadu_pd(column + j));
+        _mm512_storeu_pd(out + j, _mm512_add_pd(_mm512_loadu_pd(base + j), _mm512_mul_pd(diff, diff)));
+    }
+    addSquaredColumnScalar(base + j, column + j, testValue, out + j, n - j);
+}
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+inline void subtractSquaredColumnAvx512(const double* base, const double* column, double testValue, double* out, size_t n) {
+    __m512d test = _mm512_set1_pd(testValue);
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8) {
+        __m512d diff = _mm512_sub_pd(test, _mm512_loadu_pd(column + j));
+        _mm512_storeu_pd(out + j, _mm512_sub_pd(_mm512_loadu_pd(base + j), _mm512_mul_pd(diff, diff)));
+    }
+    subtractSquaredColumnScalar(base + j, column + j, testValue, out + j, n - j);
+}
+
+__attribute__((target("avx512f")))
+inline size_t argminAvx512(const double* values, size_t n) {
+    if (n < 16) return argminScalar(values, n);
+    __m512d best = _mm512_loadu_pd(values);
+    size_t j = 8;
+    for (; j + 8 <= n; j += 8) best = _mm512_maskz_min_pd(0xFF, best, _mm512_loadu_pd(values + j)); // maskz form avoids a GCC 12 false warning
+    double lanes[8];
+    _mm512_storeu_pd(lanes, best);
+    double minimum = lanes[0];
+    for (double lane : lanes) minimum = lane < minimum ? lane : minimum;
+    for (; j < n; ++j) minimum = values[j] < minimum ? values[j] : minimum;
+
+    // Locate the first lane holding the minimum, eight at a time
+    __m512d target = _mm512_set1_pd(minimum);
+    for (j = 0; j + 8 <= n; j += 8) {
+        __mmask8 mask = _mm512_cmp_pd_mask(_mm512_loadu_pd(values + j), target, _CMP_EQ_OQ);
+        if (mask != 0) return j + __builtin_ctz(mask);
+    }
+    return j + firstIndexOf(values + j, n - j, minimum);
+}
+
+__attribute__((target("avx512f")))
+inline size_t countAtMostAvx512(const double* values, size_t n, double bound) {
+    __m512d limit = _mm512_set1_pd(bound);
+    size_t count = 0, j = 0;
+    for (; j + 8 <= n; j += 8) count += __builtin_popcount(_mm512_cmp_pd_mask(_mm512_loadu_pd(values + j), limit, _CMP_LE_OQ));
+    return count + countAtMostScalar(values + j, n - j, bound);
+}
+
+// ---------------- Dispatch ----------------
+
+// Every kernel family this CPU can run, slowest first
+inline vector<DistanceKernels> availableDistanceKernels() {
+    vector<DistanceKernels> kernels = {{"scalar", addSquaredColumnScalar, subtractSquaredColumnScalar, argminScalar, countAtMostScalar}};
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        kernels.push_back({"sse2", addSquaredColumnSse2, subtractSquaredColumnSse2, argminSse2, countAtMostSse2});
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back({"avx2", addSquaredColumnAvx2, subtractSquaredColumnAvx2, argminAvx2, countAtMostAvx2});
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        kernels.push_back({"avx512", addSquaredColumnAvx512, subtractSquaredColumnAvx512, argminAvx512, countAtMostAvx512});
+    }
+    return kernels;
+}
+
+// Widest kernel family supported by this CPU, chosen once at startup
+inline const DistanceKernels& distanceKernels() {
+    static const DistanceKernels selected = availableDistanceKernels().back();
+    return selected;
+}
+
+// Marks the held-out row so argmin skips it
+inline void excludeRow(double* distances, size_t row) {
+    distances[row] = numeric_limits<double>::infinity();
+}
+
+// Per-thread scratch row reused across held-out rows, so the leave-one-out loops never allocate
+inline double* scratchRow(size_t n) {
+    thread_local vector<double> buffer;
+    if (buffer.size() < n) {
+        buffer.resize(n);
+        countEvent(Counter::Allocations);
+    }
+    return buffer.data();
+}
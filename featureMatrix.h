@@ -0,0 +1,115 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <set>
+#include <string>
+#include <memory>  // For shared_ptr
+#include <cstdlib> // For aligned_alloc and free
+#include <limits>  // For numeric limits
+#include <algorithm>
+
+#include "instrumentation.h"
+
+using namespace std;
+
+// Columns start on 64-byte boundaries so a subset scan streams whole cache lines
+const size_t COLUMN_ALIGNMENT = 64;
+
+// Column-major (structure-of-arrays) dataset.
+// Each feature lives in its own contiguous, aligned column and the labels have their own array,
+// so evaluating a subset only touches the columns it actually uses.
+struct FeatureMatrix {
+    size_t numRows = 0;      // Number of instances
+    size_t numFeatures = 0;  // Number of feature columns
+    size_t stride = 0;       // Doubles between the start of one column and the next (padded for alignment)
+    vector<int> labels;      // Class label of each instance
+    shared_ptr<double> values; // Backing buffer holding every column
+
+    // Raw range of each column, recorded by normalizeFeatures (empty before normalization)
+    vector<double> minValues;
+    vector<double> maxValues;
+
+    // Column access by 0-based feature index
+    double* column(size_t feature) { return values.get() + feature * stride; }
+    const double* column(size_t feature) const { return values.get() + feature * stride; }
+
+    // Single value access by row and 0-based feature index
+    double& at(size_t row, size_t feature) { return column(feature)[row]; }
+    double at(size_t row, size_t feature) const { return column(feature)[row]; }
+
+    size_t size() const { return numRows; }
+    bool empty() const { return numRows == 0; }
+};
+
+// Allocates a zeroed matrix with `rows` instances and `features` aligned columns
+inline FeatureMatrix makeFeatureMatrix(size_t rows, size_t features) {
+    FeatureMatrix matrix;
+    matrix.numRows = rows;
+    matrix.numFeatures = features;
+
+    size_t perLine = COLUMN_ALIGNMENT / sizeof(double);
+    matrix.stride = max<size_t>((rows + perLine - 1) / perLine * perLine, perLine); // Round up to a whole cache line
+
+    size_t bytes = matrix.stride * max<size_t>(features, 1) * sizeof(double);
+    double* buffer = static_cast<double*>(aligned_alloc(COLUMN_ALIGNMENT, bytes));
+    if (buffer == nullptr) {
+        cerr << "Error: Unable to allocate " << bytes << " bytes for the feature matrix" << endl;
+        exit(1);
+    }
+    fill(buffer, buffer + bytes / sizeof(double), 0.0);
+    countEvent(Counter::Allocations);
+    matrix.values = shared_ptr<double>(buffer, free);
+    matrix.labels.assign(rows, 0);
+    return matrix;
+}
+
+// A raw value scaled by its column's range to [0, 1] (outside it for values beyond the range); 0 for a constant
+// column. Loading, streaming and prediction all normalize through here, so they store the same bits.
+inline double normalizeValue(double minValue, double maxValue, double value) {
+    return maxValue != minValue ? (value - minValue) / (maxValue - minValue) : 0.0;
+}
+
+// Normalizes every feature column to the range [0, 1] using (value - min) / (max - min)
+inline void normalizeFeatures(FeatureMatrix& matrix) {
+    TraceScope trace("normalizeFeatures", "data");
+    matrix.minValues.assign(matrix.numFeatures, 0.0);
+    matrix.maxValues.assign(matrix.numFeatures, 0.0);
+    for (size_t f = 0; f < matrix.numFeatures; ++f) {
+        double* column = matrix.column(f);
+        double minValue = numeric_limits<double>::max();
+        double maxValue = numeric_limits<double>::lowest();
+
+        // Find min and max for this feature
+        for (size_t row = 0; row < matrix.numRows; ++row) {
+            minValue = min(minValue, column[row]);
+            maxValue = max(maxValue, column[row]);
+        }
+        matrix.minValues[f] = minValue;
+        matrix.maxValues[f] = maxValue;
+
+        // Normalize the column (a constant column becomes all 0)
+        for (size_t row = 0; row < matrix.numRows; ++row) {
+            column[row] = normalizeValue(minValue, maxValue, column[row]);
+        }
+    }
+}
+
+// Builds a new matrix holding only the selected columns.
+// Indices in `selectedFeatures` are 1-based and are adjusted to 0-based for internal processing.
+inline FeatureMatrix filterFeatures(const FeatureMatrix& data, const set<int>& selectedFeatures) {
+    FeatureMatrix filteredData = makeFeatureMatrix(data.numRows, selectedFeatures.size());
+    filteredData.labels = data.labels;
+
+    size_t target = 0;
+    for (int feature : selectedFeatures) {
+        const double* source = data.column(feature - 1); // Convert 1-based index to 0-based
+        copy(source, source + data.numRows, filteredData.column(target++));
+        if (!data.minValues.empty()) {
+            filteredData.minValues.push_back(data.minValues[feature - 1]);
+            filteredData.maxValues.push_back(data.maxValues[feature - 1]);
+        }
+    }
+
+    return filteredData;
+}
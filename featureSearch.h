@@ -0,0 +1,556 @@
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <chrono>
+#include <type_traits>
+
+#include "featureMatrix.h"
+#include "distanceCache.h"
+#include "threadPool.h"
+#include "nearestNeighbor.h"
+#include "quantizedFeatures.h"
+#include "subsetMemo.h"
+#include "boundedScoring.h"
+#include "kNearestNeighbors.h"
+#include "candidateRacing.h"
+#include "instrumentation.h"
+
+using namespace std;
+
+// Helper function to check if a feature is already in the selected set
+inline bool isFeatureSelected(const vector<int>& selectedFeatures, int feature) {
+    return std::find(selectedFeatures.begin(), selectedFeatures.end(), feature) != selectedFeatures.end();
+}
+
+// Memory the searches may spend on n x n distance caches unless --max-cache-mb says otherwise
+const double DEFAULT_MAX_CACHE_BYTES = 2048.0 * (1 << 20);
+
+// Settings shared by every search algorithm, filled in from the command line
+struct SearchSettings {
+    ThreadPool* pool = nullptr;                           // Runs candidates and held-out rows in parallel
+    NeighborMethod neighborMethod = NeighborMethod::Auto; // Nearest-neighbor scan used by leaveOneOutValidation
+    FeaturePrecision precision = FeaturePrecision::Float64; // Storage type the searches run on
+    SubsetMemo* memo = nullptr;                           // Skips subsets that were already scored (optional)
+    bool bounded = false;                                 // Abandons candidates that can no longer win their step
+    NeighborVote vote;                                    // k and voting rule of the classifier every subset is scored with
+    RacingSettings racing;                                // Forward selection races its candidates on sampled rows
+    int beamWidth = 4;                                    // Subsets kept per level by beam search
+    size_t topSubsets = 5;                                // Subsets exhaustive search ranks and reports
+    double maxCacheBytes = DEFAULT_MAX_CACHE_BYTES;       // Searches whose distance caches need more score directly
+};
+
+// Subset one search step committed to, its accuracy and when the step finished
+struct SearchStep {
+    vector<int> features;
+    double accuracy = 0.0;
+    double milliseconds = 0.0; // Since the search started
+};
+
+// Subset a search settled on, its leave-one-out accuracy and the steps that led there
+// (for exhaustive search, its top-ranked subsets, best first)
+struct SearchResult {
+    vector<int> features;
+    double accuracy = 0.0;
+    vector<SearchStep> steps;
+    bool failed = false; // The search could not run on this dataset (the error is already reported)
+};
+
+// Bytes `count` n x n distance caches over `data` take
+template <typename Dataset>
+double distanceCacheBytes(const Dataset& data, size_t count = 1) {
+    using Cache = typename DistanceCacheFor<Dataset>::type;
+    using D = typename decltype(Cache::squaredDistances)::value_type;
+    return static_cast<double>(data.numRows) * data.numRows * sizeof(D) * count;
+}
+
+// Whether the `count` distance caches `search` keeps over `data` fit settings.maxCacheBytes. If not, says on
+// stderr that the search scores its candidates with direct leave-one-out scans, which only need O(n * d) memory.
+template <typename Dataset>
+bool distanceCachesFit(const Dataset& data, size_t count, const char* search, const SearchSettings& settings) {
+    double bytes = distanceCacheBytes(data, count);
+    if (bytes <= settings.maxCacheBytes) return true;
+    cerr << "Note: " << search << " would need " << fixed << setprecision(0) << bytes / (1 << 20) << " MB of distance caches (limit "
+         << settings.maxCacheBytes / (1 << 20) << " MB, see --max-cache-mb); scoring candidates with direct leave-one-out instead" << endl;
+    return false;
+}
+
+inline double millisecondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// Held-out row i's squared distances to every row over `featureSubset`, summed column by column in subset order
+inline const double* subsetDistanceRow(const FeatureMatrix& data, const vector<int>& featureSubset, size_t i) {
+    const DistanceKernels& kernels = distanceKernels();
+    double* distances = scratchRow(data.numRows);
+    fill(distances, distances + data.numRows, 0.0);
+    for (int feature : featureSubset) {
+        const double* column = data.column(feature - 1);
+        kernels.addSquaredColumn(distances, column, column[i], distances, data.numRows);
+    }
+    return distances;
+}
+
+template <typename T>
+const typename QuantizedTraits<T>::Distance* subsetDistanceRow(const QuantizedMatrix<T>& data, const vector<int>& featureSubset, size_t i) {
+    using D = typename QuantizedTraits<T>::Distance;
+    const QuantizedKernels<T>& kernels = quantizedKernels<T>();
+    D* distances = quantizedScratchRow<D>(data.numRows);
+    fill(distances, distances + data.numRows, D());
+    for (int feature : featureSubset) {
+        const T* column = data.column(feature - 1);
+        kernels.addSquaredColumn(distances, column, static_cast<D>(column[i]), distances, data.numRows);
+    }
+    return distances;
+}
+
+// k-NN leave-one-out accuracy of `featureSubset` for every k from 1 to maxK, in one pass over the held-out rows
+template <typename Dataset>
+vector<double> subsetAccuracyByK(const Dataset& data, const vector<int>& featureSubset, int maxK, VoteRule rule, ThreadPool& pool) {
+    TraceScope trace("subsetAccuracyByK", "loo");
+    using D = remove_const_t<remove_pointer_t<decltype(subsetDistanceRow(data, featureSubset, 0))>>;
+    return leaveOneOutAccuracyByK<D>(data.numRows, data.labels, maxK, rule, pool,
+                                     [&](size_t i) { return subsetDistanceRow(data, featureSubset, i); });
+}
+
+// Leave-one-out validation function for accuracy computation
+// Works on a read-only view of the dataset: the held-out row is skipped in place instead of
+// copying the dataset and erasing it. Held-out rows are split across the pool and each task keeps
+// its own correct count, so the hot loop allocates nothing and shares nothing.
+// `pruning` (optional) receives how much work an early-abandon scan skipped
+// With k above 1 the subset's columns are summed per held-out row and the k nearest vote; the neighbor
+// structures of settings.neighborMethod only answer 1-NN queries.
+inline double leaveOneOutValidation(const FeatureMatrix& data, const vector<int>& featureSubset, const SearchSettings& settings, PruningCounters* pruning = nullptr) {
+    if (!settings.vote.isOneNearest()) return subsetAccuracyByK(data, featureSubset, settings.vote.k, settings.vote.rule, *settings.pool).back();
+    TraceScope trace("leaveOneOutValidation", "loo");
+    if (instrumentationEnabled) trace.args = "\"width\": " + to_string(featureSubset.size());
+    NeighborSearch search = prepareNeighborSearch(data, featureSubset, settings.neighborMethod);
+
+    size_t numChunks = (data.numRows + LOO_ROWS_PER_TASK - 1) / LOO_ROWS_PER_TASK;
+    vector<int> chunkCorrect(numChunks, 0); // Correct predictions per task, summed at the end
+    vector<PruningCounters> chunkPruning(numChunks);
+
+    settings.pool->parallelForRange(data.numRows, LOO_ROWS_PER_TASK, [&](size_t begin, size_t end) {
+        int correctPredictions = 0;
+
+        // Find nearest neighbors among every other instance, LOO_ROWS_PER_TASK held-out rows at a time
+        // (squared distances rank the same)
+        size_t queries[LOO_ROWS_PER_TASK], nearestRows[LOO_ROWS_PER_TASK];
+        double nearestSquared[LOO_ROWS_PER_TASK];
+        for (size_t blockStart = begin; blockStart < end; blockStart += LOO_ROWS_PER_TASK) {
+            size_t count = min(end - blockStart, LOO_ROWS_PER_TASK);
+            for (size_t q = 0; q < count; ++q) queries[q] = blockStart + q;
+            findNearestBatch(search, queries, count, nearestRows, nearestSquared, chunkPruning[begin / LOO_ROWS_PER_TASK]);
+
+            for (size_t q = 0; q < count; ++q) {
+                size_t i = blockStart + q;
+                int predictedLabel = nearestRows[q] == i ? -1 : data.labels[nearestRows[q]];
+
+                if (predictedLabel == data.labels[i]) { // Check if prediction is correct
+                    ++correctPredictions;
+                }
+            }
+        }
+        chunkCorrect[begin / LOO_ROWS_PER_TASK] = correctPredictions;
+    });
+
+    int correctPredictions = 0;
+    for (int count : chunkCorrect) correctPredictions += count;
+    if (pruning != nullptr) {
+        for (const auto& counters : chunkPruning) pruning->add(counters);
+    }
+    return static_cast<double>(correctPredictions) / data.numRows * 100.0; // Return accuracy
+}
+
+// Leave-one-out validation on reduced-precision storage (always a column-at-a-time scan)
+template <typename T>
+double leaveOneOutValidation(const QuantizedMatrix<T>& data, const vector<int>& featureSubset, const SearchSettings& settings) {
+    if (!settings.vote.isOneNearest()) return subsetAccuracyByK(data, featureSubset, settings.vote.k, settings.vote.rule, *settings.pool).back();
+    return quantizedLeaveOneOut(data, featureSubset, *settings.pool);
+}
+
+// Helper function to print feature sets
+inline string featureSetString(const vector<int>& featureSet) {
+    string text = "{";
+    for (size_t i = 0; i < featureSet.size(); ++i) {
+        text += to_string(featureSet[i]);
+        if (i != featureSet.size() - 1) text += ",";
+    }
+    return text + "}";
+}
+
+inline void printFeatureSet(const vector<int>& featureSet) {
+    cout << featureSetString(featureSet);
+}
+
+// Prints the rest of a candidate's trace line; an abandoned candidate only has an upper bound
+inline void printCandidateAccuracy(double accuracy) {
+    if (isAbandoned(accuracy)) {
+        cout << " accuracy is below the best of this step (scoring stopped early)\n";
+    } else {
+        cout << " accuracy is " << fixed << setprecision(1) << accuracy << "%\n";
+    }
+}
+
+// Reports how much of a step's leave-one-out work bounded scoring skipped (nothing when it is off)
+inline void printSkippedPredictions(const StepBound& bound, const SearchSettings& settings) {
+    if (!settings.bounded) return;
+    cout << "(Bounded scoring skipped " << bound.predictionsSkipped << " of "
+         << bound.predictionsMade + bound.predictionsSkipped << " held-out predictions, "
+         << fixed << setprecision(1) << bound.skippedFraction() * 100.0 << "%)\n";
+}
+
+// Scores one candidate of a search step through the memo. With bounded scoring on, remembered scores
+// still raise the step's bound so later candidates can be abandoned against them.
+template <typename Evaluate>
+double scoreCandidate(const SearchSettings& settings, StepBound& bound, size_t numRows, const vector<int>& subset, Evaluate evaluate) {
+    TraceScope trace("candidate", "search");
+    if (instrumentationEnabled) trace.args = "\"subset\": \"" + featureSetString(subset) + "\"";
+    countEvent(Counter::CandidateEvaluations);
+    double accuracy = memoizedAccuracy(settings.memo, subset, evaluate);
+    if (settings.bounded) bound.offerAccuracy(accuracy, numRows);
+    return accuracy;
+}
+
+// Scores one forward step's candidates by racing them (see candidateRacing.h). Subsets the memo already
+// knows join the race with their exact score; survivors' exact scores are added to it.
+template <typename Dataset, typename Cache>
+RaceOutcome raceFeatureAdditions(const Cache& cache, const Dataset& data, const vector<int>& selectedFeatures, const vector<int>& candidates,
+                                 int step, const SearchSettings& settings) {
+    vector<double> known(candidates.size(), ABANDONED_ACCURACY);
+    vector<vector<int>> subsets(candidates.size(), selectedFeatures);
+    for (size_t c = 0; c < candidates.size(); ++c) {
+        subsets[c].push_back(candidates[c]);
+        countEvent(Counter::CandidateEvaluations);
+        if (settings.memo != nullptr) settings.memo->lookup(subsets[c], known[c]);
+    }
+
+    RaceOutcome race = raceCandidates(candidates.size(), data.numRows, known, settings.racing, static_cast<uint64_t>(step), *settings.pool,
+                                      [&](size_t c, size_t i) { return additionPredictsCorrectly(cache, data, candidates[c], i, settings.vote); });
+
+    if (settings.memo != nullptr) {
+        for (size_t c = 0; c < candidates.size(); ++c) {
+            if (isAbandoned(known[c])) settings.memo->store(subsets[c], race.accuracies[c]);
+        }
+    }
+    return race;
+}
+
+// Rest of the trace line of a candidate racing dropped: how far it got and what it scored there
+inline void printRacedOutCandidate(const RaceOutcome& race, size_t c) {
+    cout << " dropped by racing after " << race.rowsScored[c] << " held-out rows (estimated "
+         << fixed << setprecision(1) << race.estimates[c] << "%)\n";
+}
+
+// Reports how many candidates a racing step carried to every row and how much work it skipped
+inline void printRacingSummary(const RaceOutcome& race, size_t numCandidates, size_t numRows, const SearchSettings& settings) {
+    if (!settings.racing.enabled) return;
+    uint64_t total = race.predictionsMade + race.predictionsSkipped;
+    cout << "(Racing scored " << race.survivors << " of " << numCandidates << " candidates on all " << numRows
+         << " rows and skipped " << race.predictionsSkipped << " of " << total << " held-out predictions, "
+         << fixed << setprecision(1) << (total == 0 ? 0.0 : 100.0 * race.predictionsSkipped / total) << "%)\n";
+}
+
+// The searches end trace lines with '\n' rather than endl, so a long search is not flushed once per candidate.
+
+// Forward Selection Algorithm
+template <typename Dataset>
+SearchResult forwardSelection(const Dataset& data, int totalFeatures, const SearchSettings& settings) {
+    ThreadPool& pool = *settings.pool;
+    TraceScope trace("forwardSelection", "search");
+    auto searchStart = chrono::steady_clock::now();
+    vector<SearchStep> steps; // Trail of committed subsets for callers that record it
+
+    cout << "Running nearest neighbor with no features (default rate), using \"leave-one-out\" evaluation, I get an accuracy of "
+         << fixed << setprecision(1)
+         << memoizedAccuracy(settings.memo, {}, [&] { return leaveOneOutValidation(data, {}, settings); }) << "%\n";
+
+    cout << "Beginning search.\n";
+
+    vector<int> selectedFeatures; // Track selected features
+    double bestOverallAccuracy = 0.0;
+
+    bool useCache = distanceCachesFit(data, 1, "Forward selection", settings);
+    bool racing = settings.racing.enabled && useCache; // Racing scores its rows against the cache
+    if (settings.racing.enabled && !racing) cerr << "Note: racing needs the distance cache, so every candidate is scored on all rows" << endl;
+    typename DistanceCacheFor<Dataset>::type cache; // Squared distances over the selected features, extended one column per step
+    if (useCache) buildDistanceCache(cache, data, selectedFeatures);
+
+    for (int i = 1; i <= totalFeatures; ++i) {
+        StepProfiler stepProfile("forward", i);
+        int bestFeature = -1;
+        double bestAccuracy = 0.0;
+
+        // Collect unselected features
+        vector<int> candidates;
+        for (int feature = 1; feature <= totalFeatures; ++feature) {
+            if (find(selectedFeatures.begin(), selectedFeatures.end(), feature) == selectedFeatures.end()) {
+                candidates.push_back(feature);
+            }
+        }
+
+        // Score every candidate concurrently, then report and compare them in feature order
+        vector<double> accuracies(candidates.size());
+        StepBound bound; // Used only with bounded scoring
+        StepBound* stepBound = settings.bounded ? &bound : nullptr;
+        RaceOutcome race; // Used only with racing, which replaces the full scoring below
+        if (racing) {
+            race = raceFeatureAdditions(cache, data, selectedFeatures, candidates, i, settings);
+            accuracies = race.accuracies;
+        } else {
+            pool.parallelFor(candidates.size(), [&](size_t c) {
+                vector<int> subset = selectedFeatures;
+                subset.push_back(candidates[c]);
+                accuracies[c] = scoreCandidate(settings, bound, data.numRows, subset, [&] {
+                    return useCache ? evaluateFeatureAddition(cache, data, candidates[c], pool, stepBound, settings.vote) : leaveOneOutValidation(data, subset, settings);
+                });
+            });
+        }
+
+        for (size_t c = 0; c < candidates.size(); ++c) {
+            int feature = candidates[c];
+            double accuracy = accuracies[c];
+            vector<int> tempFeatures = selectedFeatures;
+            tempFeatures.push_back(feature);
+
+            cout << "Using feature(s) ";
+            printFeatureSet(tempFeatures);
+            if (racing && isAbandoned(accuracy)) printRacedOutCandidate(race, c);
+            else printCandidateAccuracy(accuracy);
+
+            if (accuracy > bestAccuracy) { // Strict comparison keeps the lowest feature on ties
+                bestAccuracy = accuracy;
+                bestFeature = feature; // Update best feature
+            }
+        }
+        printSkippedPredictions(bound, settings);
+        if (racing) printRacingSummary(race, candidates.size(), data.numRows, settings);
+
+        if (bestFeature != -1) {
+            selectedFeatures.push_back(bestFeature);
+            if (useCache) addFeatureToCache(cache, data, bestFeature);
+            if (bestAccuracy < bestOverallAccuracy) {
+                cout << "(Warning, Accuracy has decreased!)\n";
+            }
+            bestOverallAccuracy = bestAccuracy;
+            steps.push_back({selectedFeatures, bestOverallAccuracy, millisecondsSince(searchStart)});
+
+            cout << "Feature set ";
+            printFeatureSet(selectedFeatures);
+            cout << " was best, accuracy is " << fixed << setprecision(1) << bestOverallAccuracy << "%\n";
+        } else {
+            break; // Stop if no features improve accuracy
+        }
+    }
+
+    cout << "Finished search!! The best feature subset is ";
+    printFeatureSet(selectedFeatures);
+    cout << ", which has an accuracy of " << fixed << setprecision(1) << bestOverallAccuracy << "%\n";
+    return {selectedFeatures, bestOverallAccuracy, steps};
+}
+
+// Backward Elimination Algorithm
+template <typename Dataset>
+SearchResult backwardElimination(const Dataset& dataset, int totalFeatures, const SearchSettings& settings) {
+    ThreadPool& pool = *settings.pool;
+    TraceScope trace("backwardElimination", "search");
+    auto searchStart = chrono::steady_clock::now();
+    vector<SearchStep> steps; // Trail of committed subsets for callers that record it
+
+    // Start with all features
+    vector<int> selectedFeatures;
+    for (int i = 1; i <= totalFeatures; ++i) {
+        selectedFeatures.push_back(i);
+    }
+
+    // Evaluate the full set initially
+    double bestAccuracy = memoizedAccuracy(settings.memo, selectedFeatures, [&] { return leaveOneOutValidation(dataset, selectedFeatures, settings); });
+
+    bool useCache = distanceCachesFit(dataset, 1, "Backward elimination", settings);
+    typename DistanceCacheFor<Dataset>::type cache; // Squared distances over the full current set, shrunk one column per step
+    if (useCache) buildDistanceCache(cache, dataset, selectedFeatures);
+
+    cout << "Using all features and \"leave-one-out\" evaluation, I get an accuracy of "
+         << fixed << setprecision(1) << bestAccuracy << "%\n";
+    cout << "Beginning search.\n";
+
+    int step = 0;
+    while (selectedFeatures.size() > 1) {
+        StepProfiler stepProfile("backward", ++step);
+        int worstFeature = -1;  // Track the feature whose removal gives the best improvement
+        double maxAccuracy = 0; // Track the best accuracy after removing a feature
+
+        // Evaluate accuracy for every removal concurrently by subtracting that feature's column
+        vector<double> accuracies(selectedFeatures.size());
+        StepBound bound; // Used only with bounded scoring
+        StepBound* stepBound = settings.bounded ? &bound : nullptr;
+        pool.parallelFor(selectedFeatures.size(), [&](size_t i) {
+            vector<int> subset = selectedFeatures;
+            subset.erase(subset.begin() + i);
+            accuracies[i] = scoreCandidate(settings, bound, dataset.numRows, subset, [&] {
+                return useCache ? evaluateFeatureRemoval(cache, dataset, selectedFeatures[i], pool, stepBound, settings.vote) : leaveOneOutValidation(dataset, subset, settings);
+            });
+        });
+
+        for (size_t i = 0; i < selectedFeatures.size(); ++i) {
+            int feature = selectedFeatures[i]; // Feature to evaluate removal
+            double accuracy = accuracies[i];
+
+            // Create a temporary subset without the current feature
+            vector<int> tempSet = selectedFeatures;
+            tempSet.erase(tempSet.begin() + i);
+
+            // Print the trace for this evaluation
+            cout << "Using feature(s) ";
+            printFeatureSet(tempSet);
+            printCandidateAccuracy(accuracy);
+
+            // Update the worst feature for this step if accuracy improves
+            if (accuracy > maxAccuracy) {
+                maxAccuracy = accuracy;
+                worstFeature = feature;
+            }
+        }
+        printSkippedPredictions(bound, settings);
+
+        if (worstFeature != -1) {
+            // Remove the identified "worst" feature permanently
+            selectedFeatures.erase(remove(selectedFeatures.begin(), selectedFeatures.end(), worstFeature), selectedFeatures.end());
+            if (useCache) removeFeatureFromCache(cache, dataset, worstFeature);
+
+            if (maxAccuracy < bestAccuracy) {
+                cout << "(Warning, Accuracy has decreased!)\n";
+            }
+
+            bestAccuracy = maxAccuracy;
+            steps.push_back({selectedFeatures, bestAccuracy, millisecondsSince(searchStart)});
+
+            cout << "Feature set ";
+            printFeatureSet(selectedFeatures);
+            cout << " was best, accuracy is " << fixed << setprecision(1) << bestAccuracy << "%\n";
+        } else {
+            cout << "No further improvements possible.\n";
+            break;
+        }
+    }
+
+    // Final output: Best feature subset and its accuracy
+    cout << "Finished search!! The best feature subset is ";
+    printFeatureSet(selectedFeatures);
+    cout << ", which has an accuracy of " << fixed << setprecision(1) << bestAccuracy << "%\n";
+    return {selectedFeatures, bestAccuracy, steps};
+}
+
+// Bidirectional search combines forward selection and backward elimination
+template <typename Dataset>
+SearchResult bidirectionalSearch(const Dataset& data, int totalFeatures, const SearchSettings& settings) {
+    ThreadPool& pool = *settings.pool;
+    TraceScope trace("bidirectionalSearch", "search");
+    auto searchStart = chrono::steady_clock::now();
+    vector<SearchStep> steps; // Trail of committed subsets for callers that record it
+
+    cout << "Starting Bidirectional Search...\n";
+
+    vector<int> forwardSelectedFeatures; // Features selected during forward selection
+    vector<int> backwardSelectedFeatures;
+    for (int i = 1; i <= totalFeatures; ++i) {
+        backwardSelectedFeatures.push_back(i); // Initialize with all features
+    }
+
+    double bestAccuracy = memoizedAccuracy(settings.memo, {}, [&] { return leaveOneOutValidation(data, {}, settings); }); // Initial accuracy with no features
+    vector<int> bestFeatureSet;
+
+    bool useCaches = distanceCachesFit(data, 2, "Bidirectional search", settings); // Both directions keep one
+    typename DistanceCacheFor<Dataset>::type forwardCache; // Squared distances over forwardSelectedFeatures
+    if (useCaches) buildDistanceCache(forwardCache, data, forwardSelectedFeatures);
+    typename DistanceCacheFor<Dataset>::type backwardCache; // Squared distances over backwardSelectedFeatures
+    if (useCaches) buildDistanceCache(backwardCache, data, backwardSelectedFeatures);
+
+    int step = 0;
+    while (!backwardSelectedFeatures.empty() || forwardSelectedFeatures.size() < totalFeatures) {
+        StepProfiler stepProfile("bidirectional", ++step);
+        int bestFeatureToAdd = -1, bestFeatureToRemove = -1;
+        double bestForwardAccuracy = 0.0, bestBackwardAccuracy = 0.0;
+
+        vector<int> additions; // Features the forward step can add
+        for (int feature = 1; feature <= totalFeatures; ++feature) {
+            if (find(forwardSelectedFeatures.begin(), forwardSelectedFeatures.end(), feature) == forwardSelectedFeatures.end()) {
+                additions.push_back(feature);
+            }
+        }
+
+        // Score the forward and backward candidates together in one parallel batch. They share one bound:
+        // a candidate that cannot reach the best of either direction cannot decide the step.
+        vector<double> accuracies(additions.size() + backwardSelectedFeatures.size());
+        StepBound bound; // Used only with bounded scoring
+        StepBound* stepBound = settings.bounded ? &bound : nullptr;
+        pool.parallelFor(accuracies.size(), [&](size_t c) {
+            if (c < additions.size()) {
+                vector<int> subset = forwardSelectedFeatures;
+                subset.push_back(additions[c]);
+                accuracies[c] = scoreCandidate(settings, bound, data.numRows, subset, [&] {
+                    return useCaches ? evaluateFeatureAddition(forwardCache, data, additions[c], pool, stepBound, settings.vote) : leaveOneOutValidation(data, subset, settings);
+                });
+            } else {
+                size_t i = c - additions.size();
+                vector<int> subset = backwardSelectedFeatures;
+                subset.erase(subset.begin() + i);
+                accuracies[c] = scoreCandidate(settings, bound, data.numRows, subset, [&] {
+                    return useCaches ? evaluateFeatureRemoval(backwardCache, data, backwardSelectedFeatures[i], pool, stepBound, settings.vote) : leaveOneOutValidation(data, subset, settings);
+                });
+            }
+        });
+        printSkippedPredictions(bound, settings);
+
+        // Forward selection step
+        for (size_t c = 0; c < additions.size(); ++c) {
+            double accuracy = accuracies[c];
+            if (accuracy > bestForwardAccuracy) {
+                bestForwardAccuracy = accuracy;
+                bestFeatureToAdd = additions[c]; // Feature to add
+            }
+        }
+
+        // Backward elimination step
+        for (size_t i = 0; i < backwardSelectedFeatures.size(); ++i) {
+            double accuracy = accuracies[additions.size() + i];
+            if (accuracy > bestBackwardAccuracy) {
+                bestBackwardAccuracy = accuracy;
+                bestFeatureToRemove = backwardSelectedFeatures[i]; // Feature to remove
+            }
+        }
+
+        // Decide the better action (add or remove)
+        if (bestForwardAccuracy > bestBackwardAccuracy) {
+            forwardSelectedFeatures.push_back(bestFeatureToAdd);
+            if (useCaches) addFeatureToCache(forwardCache, data, bestFeatureToAdd);
+            backwardSelectedFeatures.erase(remove(backwardSelectedFeatures.begin(), backwardSelectedFeatures.end(), bestFeatureToAdd), backwardSelectedFeatures.end());
+            if (useCaches) removeFeatureFromCache(backwardCache, data, bestFeatureToAdd);
+            bestAccuracy = bestForwardAccuracy;
+            bestFeatureSet = forwardSelectedFeatures;
+            steps.push_back({bestFeatureSet, bestAccuracy, millisecondsSince(searchStart)});
+            cout << "Added feature " << bestFeatureToAdd << ", accuracy: " << fixed << setprecision(1) << bestAccuracy << "%\n";
+        } else if (bestBackwardAccuracy >= bestForwardAccuracy) {
+            backwardSelectedFeatures.erase(remove(backwardSelectedFeatures.begin(), backwardSelectedFeatures.end(), bestFeatureToRemove), backwardSelectedFeatures.end());
+            if (useCaches) removeFeatureFromCache(backwardCache, data, bestFeatureToRemove);
+            if (isFeatureSelected(forwardSelectedFeatures, bestFeatureToRemove)) {
+                forwardSelectedFeatures.erase(remove(forwardSelectedFeatures.begin(), forwardSelectedFeatures.end(), bestFeatureToRemove), forwardSelectedFeatures.end());
+                if (useCaches) buildDistanceCache(forwardCache, data, forwardSelectedFeatures); // Column removed, rebuild the partial sums
+            }
+            bestAccuracy = bestBackwardAccuracy;
+            bestFeatureSet = backwardSelectedFeatures;
+            steps.push_back({bestFeatureSet, bestAccuracy, millisecondsSince(searchStart)});
+            cout << "Removed feature " << bestFeatureToRemove << ", accuracy: " << fixed << setprecision(1) << bestAccuracy << "%\n";
+        } else {
+            break; // Exit if neither action improves accuracy
+        }
+    }
+
+    cout << "Finished Bidirectional Search! Best feature subset: ";
+    printFeatureSet(bestFeatureSet);
+    cout << " with accuracy: " << fixed << setprecision(1) << bestAccuracy << "%\n";
+    return {bestFeatureSet, bestAccuracy, steps};
+}
@@ -26,9 +26,29 @@
 #include <iomanip> // For std::fixed and std::setprecision
 #include <fstream> // For file operations
 #include <sstream> // For string stream processing
+#include <chrono>  // For timing the precision report and batch runs
 #include <cmath>   // For mathematical operations
 #include <set>     // For set data structure
 #include <limits>  // For numeric limits
+#include <cstring> // For strcmp
+#include <thread>  // For hardware_concurrency
+
+#include "featureMatrix.h" // Columnar dataset storage and normalization
+#include "datasetParser.h" // Memory-mapped dataset parsing
+#include "datasetCache.h"  // Binary cache of the normalized dataset
+#include "distanceCache.h" // Incremental pairwise distances for the search loops
+#include "threadPool.h"    // Work-stealing pool for parallel candidate evaluation
+#include "nearestNeighbor.h" // Brute-force and early-abandon nearest-neighbor scans
+#include "quantizedFeatures.h" // float32 / int16 / int8 feature storage
+#include "subsetMemo.h"     // Accuracies of subsets already scored
+#include "boundedScoring.h" // Abandons candidates that can no longer win their step
+#include "kNearestNeighbors.h" // k-NN voting and one-pass scoring of every k up to K
+#include "candidateRacing.h" // Racing forward candidates on sampled held-out rows
+#include "featureSearch.h"  // Forward, backward and bidirectional search
+#include "searchStrategies.h" // Floating and beam search, and the table of every strategy
+#include "streamingEvaluation.h" // Block-by-block leave-one-out for files larger than memory
+#include "batchPrediction.h" // Labels for the rows of a new file from a trained subset
+#include "predictionServer.h" // The same predictions served over a Unix domain socket
 
 using namespace std;
 
@@ -37,336 +57,418 @@ double evaluateFeatureSet(const vector<int>& featureSet) {
     return (rand() % 10000) / 100.0; // Generates a random floating-point value between 0.00 and 99.99
 }
 
-// Helper function to check if a feature is already in the selected set
-bool isFeatureSelected(const vector<int>& selectedFeatures, int feature) {
-    return std::find(selectedFeatures.begin(), selectedFeatures.end(), feature) != selectedFeatures.end();
+// Accuracy-equivalence report: runs every search at every precision on each dataset (traces suppressed) and
+// compares the chosen subset and its accuracy with the double-precision result
+void printPrecisionReport(const vector<string>& filenames, SearchSettings settings) {
+    settings.memo = nullptr; // Every run is timed from scratch
+    const char* algorithms[] = {"forward", "backward", "bidirectional"};
+    const FeaturePrecision precisions[] = {FeaturePrecision::Float64, FeaturePrecision::Float32, FeaturePrecision::Int16, FeaturePrecision::Int8};
+    const int bytesPerValue[] = {8, 4, 2, 1};
+
+    cout << left << setw(26) << "Dataset" << setw(15) << "Algorithm" << setw(11) << "Precision" << setw(7) << "Bytes"
+         << setw(10) << "Accuracy" << setw(10) << "Time(ms)" << setw(13) << "Same as f64" << "Subset" << endl;
+    for (const string& filename : filenames) {
+        FeatureMatrix instances;
+        loadNormalizedDataset(filename, instances, settings.pool);
+
+        for (int choice = 1; choice <= 3; ++choice) {
+            SearchResult reference;
+            for (size_t p = 0; p < 4; ++p) {
+                settings.precision = precisions[p];
+                bool valid;
+                ostringstream trace; // The searches' step-by-step output is not part of the report
+                streambuf* console = cout.rdbuf(trace.rdbuf());
+                auto start = chrono::steady_clock::now();
+                SearchResult result = runSearchAtPrecision(instances, precisions[p], choice, settings, valid);
+                double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                cout.rdbuf(console);
+
+                if (p == 0) reference = result;
+                bool same = result.features == reference.features && result.accuracy == reference.accuracy;
+                cout << left << setw(26) << filename << setw(15) << algorithms[choice - 1] << setw(11) << featurePrecisionName(precisions[p])
+                     << setw(7) << bytesPerValue[p] << setw(10) << fixed << setprecision(1) << result.accuracy
+                     << setw(10) << setprecision(0) << milliseconds << setw(13) << (same ? "yes" : "no");
+                printFeatureSet(result.features);
+                cout << endl;
+            }
+        }
+    }
 }
 
-// Struct to represent an instance with features and label
-struct Instance {
-    vector<double> features; // Stores feature values
-    int label;               // Class label
-};
+// Racing report: runs forward selection exactly and with racing on each dataset (traces suppressed) and shows
+// the speed-up, whether racing settled on the same subset, how many of its steps committed the same subset,
+// and the largest accuracy any step gave up against the exact search
+void printRacingReport(const vector<string>& filenames, SearchSettings settings) {
+    settings.memo = nullptr; // Both runs score everything themselves
+    RacingSettings racing = settings.racing;
+    racing.enabled = true;
+
+    cout << left << setw(26) << "Dataset" << setw(12) << "Exact(ms)" << setw(12) << "Racing(ms)" << setw(9) << "Speedup"
+         << setw(11) << "Exact acc" << setw(12) << "Racing acc" << setw(7) << "Same" << setw(16) << "Steps agreeing" << "Max step loss" << endl;
+    size_t differing = 0;
+    for (const string& filename : filenames) {
+        FeatureMatrix instances;
+        loadNormalizedDataset(filename, instances, settings.pool);
+
+        SearchResult results[2];
+        double milliseconds[2];
+        for (int run = 0; run < 2; ++run) {
+            settings.racing = run == 0 ? RacingSettings() : racing;
+            bool valid;
+            ostringstream trace; // The searches' step-by-step output is not part of the report
+            streambuf* console = cout.rdbuf(trace.rdbuf());
+            auto start = chrono::steady_clock::now();
+            results[run] = runSearchAtPrecision(instances, settings.precision, 1, settings, valid);
+            milliseconds[run] = millisecondsSince(start);
+            cout.rdbuf(console);
+        }
 
-// Function to parse the dataset from a file
-void parseDataset(const string& filename, vector<Instance>& instances) {
-    ifstream file(filename); // Open the file
-    if (!file.is_open()) { // Check if file opens successfully
-        cerr << "Error: Unable to open file " << filename << endl;
-        exit(1); // Exit if file cannot be opened
+        const SearchResult& exact = results[0];
+        const SearchResult& raced = results[1];
+        auto sameSet = [](vector<int> a, vector<int> b) {
+            sort(a.begin(), a.end());
+            sort(b.begin(), b.end());
+            return a == b;
+        };
+        bool same = sameSet(exact.features, raced.features) && exact.accuracy == raced.accuracy;
+        differing += !same;
+        size_t agreeing = 0;
+        double maxLoss = 0.0; // Percentage points
+        for (size_t s = 0; s < min(exact.steps.size(), raced.steps.size()); ++s) {
+            agreeing += sameSet(exact.steps[s].features, raced.steps[s].features);
+            maxLoss = max(maxLoss, exact.steps[s].accuracy - raced.steps[s].accuracy);
+        }
+        string agreement = to_string(agreeing) + " of " + to_string(exact.steps.size());
+        cout << left << setw(26) << filename << fixed << setprecision(0) << setw(12) << milliseconds[0] << setw(12) << milliseconds[1]
+             << setprecision(2) << setw(9) << (milliseconds[1] > 0.0 ? milliseconds[0] / milliseconds[1] : 0.0)
+             << setprecision(1) << setw(11) << exact.accuracy << setw(12) << raced.accuracy << setw(7) << (same ? "yes" : "no")
+             << setw(16) << agreement << maxLoss << endl;
     }
+    cout << "Racing (confidence " << setprecision(3) << racing.confidence << ", seed " << racing.seed << ") chose a different subset on "
+         << differing << " of " << filenames.size() << " datasets" << endl;
+}
 
-    string line;
-    while (getline(file, line)) { // Read each line from file
-        stringstream ss(line); // Process the line using stringstream
-        double value;
-        vector<double> features; // To store feature values
-        int label; // To store class label
-
-        ss >> label; // Extract label (first column)
-        while (ss >> value) { // Extract feature values
-            features.push_back(value);
-        }
+// Discards everything written to it; stands in for cout while batch searches run
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) override { return traits_type::not_eof(c); }
+    streamsize xsputn(const char*, streamsize count) override { return count; }
+};
 
-        if (!features.empty() && features[0] == 0) {
-            features.erase(features.begin()); // Remove extraneous initial values
-        }
+// One dataset/algorithm pair run in batch mode
+struct BatchRun {
+    string dataset;
+    size_t rows = 0;
+    size_t features = 0;
+    string algorithm;           // forward, backward, bidir, or subset for --features
+    SearchResult result;
+    vector<double> accuracyByK; // --k-sweep: accuracy of the final subset for k = 1, 2, ...
+    double loadMilliseconds = 0.0;
+    double searchMilliseconds = 0.0;
+};
 
-        instances.push_back({features, label}); // Add instance to dataset
+// Parses a comma-separated --algo list of strategy names into menu choices
+bool parseAlgorithmList(const string& list, vector<int>& choices) {
+    stringstream names(list);
+    string name;
+    while (getline(names, name, ',')) {
+        int choice = searchChoice(name);
+        if (choice == 0) return false;
+        choices.push_back(choice);
     }
-
-    file.close(); // Close the file
+    return !choices.empty();
 }
 
-// Function to normalize features in the dataset
-void normalizeFeatures(vector<Instance>& instances) {
-    size_t numFeatures = instances[0].features.size(); // Get number of features
-    vector<double> minValues(numFeatures, numeric_limits<double>::max()); // Initialize minimum values
-    vector<double> maxValues(numFeatures, numeric_limits<double>::lowest()); // Initialize maximum values
-
-    // Find min and max for each feature
-    for (const auto& instance : instances) {
-        for (size_t i = 0; i < numFeatures; ++i) {
-            minValues[i] = min(minValues[i], instance.features[i]);
-            maxValues[i] = max(maxValues[i], instance.features[i]);
-        }
+// Parses a comma-separated list of 1-based feature numbers
+bool parseFeatureList(const string& list, vector<int>& features) {
+    stringstream numbers(list);
+    string number;
+    while (getline(numbers, number, ',')) {
+        char* end = nullptr;
+        long feature = strtol(number.c_str(), &end, 10);
+        if (number.empty() || *end != '\0' || feature < 1) return false;
+        features.push_back(static_cast<int>(feature));
     }
+    return !features.empty();
+}
 
-    // Normalize features
-    for (auto& instance : instances) {
-        for (size_t i = 0; i < numFeatures; ++i) {
-            if (maxValues[i] != minValues[i]) {
-                instance.features[i] = (instance.features[i] - minValues[i]) / (maxValues[i] - minValues[i]);
-            } else {
-                instance.features[i] = 0.0; // Set to 0 if min and max are the same
-            }
-        }
+// Leave-one-out accuracy of one subset with the dataset stored at settings.precision
+double subsetAccuracyAtPrecision(const FeatureMatrix& instances, const vector<int>& features, const SearchSettings& settings) {
+    switch (settings.precision) {
+    case FeaturePrecision::Float32: return leaveOneOutValidation(quantizeFeatures<float>(instances), features, settings);
+    case FeaturePrecision::Int16: return leaveOneOutValidation(quantizeFeatures<uint16_t>(instances), features, settings);
+    case FeaturePrecision::Int8: return leaveOneOutValidation(quantizeFeatures<uint8_t>(instances), features, settings);
+    default: return leaveOneOutValidation(instances, features, settings);
     }
 }
 
-// Function to calculate Euclidean distance between two feature vectors
-double calculateDistance(const vector<double>& a, const vector<double>& b) {
-    double distance = 0.0;
-    for (size_t i = 0; i < a.size(); ++i) {
-        distance += pow(a[i] - b[i], 2); // Sum of squared differences
+// k-NN accuracy of one subset for every k up to maxK with the dataset stored at settings.precision
+vector<double> accuracyByKAtPrecision(const FeatureMatrix& instances, const vector<int>& features, int maxK, const SearchSettings& settings) {
+    VoteRule rule = settings.vote.rule;
+    ThreadPool& pool = *settings.pool;
+    switch (settings.precision) {
+    case FeaturePrecision::Float32: return subsetAccuracyByK(quantizeFeatures<float>(instances), features, maxK, rule, pool);
+    case FeaturePrecision::Int16: return subsetAccuracyByK(quantizeFeatures<uint16_t>(instances), features, maxK, rule, pool);
+    case FeaturePrecision::Int8: return subsetAccuracyByK(quantizeFeatures<uint8_t>(instances), features, maxK, rule, pool);
+    default: return subsetAccuracyByK(instances, features, maxK, rule, pool);
     }
-    return sqrt(distance); // Return square root of sum
 }
 
-// Filters dataset to retain only selected features
-vector<Instance> filterFeatures(const vector<Instance>& data, const set<int>& selectedFeatures) {
-    vector<Instance> filteredData; // Filtered dataset
+// Memo file for a dataset. Precision and classifier both change accuracies, so each combination gets its own
+// file; 1-NN keeps the original "<file>.<precision>.memo" name.
+string subsetMemoPath(const string& filename, const SearchSettings& settings) {
+    string path = filename + "." + featurePrecisionName(settings.precision);
+    if (!settings.vote.isOneNearest()) path += ".k" + to_string(settings.vote.k) + "-" + voteRuleName(settings.vote.rule);
+    return path + ".memo";
+}
 
-    for (const auto& instance : data) {
-        vector<double> filteredFeatures;
-        for (int feature : selectedFeatures) {
-            filteredFeatures.push_back(instance.features[feature - 1]); // Convert 1-based index to 0-based
-        }
-        filteredData.push_back({filteredFeatures, instance.label});
+// Variant stamped into memo files, so a memo renamed between classifiers is still rejected
+uint32_t subsetMemoVariant(const SearchSettings& settings) {
+    uint32_t variant = static_cast<uint32_t>(settings.precision);
+    if (!settings.vote.isOneNearest()) {
+        variant |= static_cast<uint32_t>(settings.vote.k) << 8 | static_cast<uint32_t>(settings.vote.rule) << 30;
     }
-
-    return filteredData;
+    return variant;
 }
 
-// Leave-one-out validation function for accuracy computation
-double leaveOneOutValidation(vector<Instance>& data, const vector<int>& featureSubset) {
-    int correctPredictions = 0;
+// Feature list for CSV cells and text output: space-separated so it never collides with the CSV delimiter
+string featureListText(const vector<int>& features) {
+    string text;
+    for (size_t i = 0; i < features.size(); ++i) text += (i ? " " : "") + to_string(features[i]);
+    return text;
+}
 
-    for (size_t i = 0; i < data.size(); ++i) {
-        vector<Instance> trainingSet = data;
-        Instance testInstance = trainingSet[i];
-        trainingSet.erase(trainingSet.begin() + i); // Leave out one instance
+string jsonFeatureArray(const vector<int>& features) {
+    string text = "[";
+    for (size_t i = 0; i < features.size(); ++i) text += (i ? ", " : "") + to_string(features[i]);
+    return text + "]";
+}
 
-        // Filter features for training and test sets
-        for (auto& instance : trainingSet) {
-            vector<double> filteredFeatures;
-            for (int feature : featureSubset) {
-                filteredFeatures.push_back(instance.features[feature - 1]);
-            }
-            instance.features = filteredFeatures;
-        }
-        vector<double> testFeatures;
-        for (int feature : featureSubset) {
-            testFeatures.push_back(testInstance.features[feature - 1]);
+// Quotes `text` as a JSON string, escaping quotes, backslashes and control characters
+string jsonString(const string& text) {
+    string quoted = "\"";
+    for (char c : text) {
+        if (c == '\n') {
+            quoted += "\\n";
+        } else if (c == '\t') {
+            quoted += "\\t";
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned char>(c));
+            quoted += escape;
+        } else {
+            if (c == '"' || c == '\\') quoted += '\\';
+            quoted += c;
         }
-        testInstance.features = testFeatures;
-
-        // Find nearest neighbor
-        double minDistance = numeric_limits<double>::max();
-        int predictedLabel = -1;
+    }
+    return quoted + "\"";
+}
 
-        for (const auto& trainInstance : trainingSet) {
-            double distance = calculateDistance(testInstance.features, trainInstance.features);
-            if (distance < minDistance) {
-                minDistance = distance;
-                predictedLabel = trainInstance.label;
-            }
+void writeBatchJson(ostream& out, const vector<BatchRun>& runs) {
+    out << fixed << "{\n  \"runs\": [";
+    for (size_t r = 0; r < runs.size(); ++r) {
+        const BatchRun& run = runs[r];
+        out << (r ? ",\n" : "\n") << "    {\"dataset\": " << jsonString(run.dataset) << ", \"rows\": " << run.rows
+            << ", \"features\": " << run.features << ", \"algorithm\": \"" << run.algorithm << "\",\n"
+            << "     \"subset\": " << jsonFeatureArray(run.result.features) << ", \"accuracy\": " << setprecision(4) << run.result.accuracy
+            << ", \"load_ms\": " << setprecision(3) << run.loadMilliseconds << ", \"search_ms\": " << run.searchMilliseconds;
+        if (!run.accuracyByK.empty()) {
+            out << ",\n     \"accuracy_by_k\": [";
+            for (size_t k = 0; k < run.accuracyByK.size(); ++k) out << (k ? ", " : "") << setprecision(4) << run.accuracyByK[k];
+            out << "]";
         }
-
-        if (predictedLabel == testInstance.label) { // Check if prediction is correct
-            ++correctPredictions;
+        out << ",\n     \"steps\": [";
+        for (size_t s = 0; s < run.result.steps.size(); ++s) {
+            const SearchStep& step = run.result.steps[s];
+            out << (s ? ", " : "") << "{\"step\": " << s + 1 << ", \"subset\": " << jsonFeatureArray(step.features)
+                << ", \"accuracy\": " << setprecision(4) << step.accuracy << ", \"elapsed_ms\": " << setprecision(3) << step.milliseconds << "}";
         }
+        out << "]}";
     }
-
-    return static_cast<double>(correctPredictions) / data.size() * 100.0; // Return accuracy
+    out << "\n  ]\n}\n";
 }
 
-// Helper function to print feature sets
-void printFeatureSet(const vector<int>& featureSet) {
-    cout << "{";
-    for (size_t i = 0; i < featureSet.size(); ++i) {
-        cout << featureSet[i];
-        if (i != featureSet.size() - 1) cout << ",";
+// `text` as a CSV field: quoted, with quotes doubled, when it holds a comma, quote or line break (RFC 4180)
+string csvField(const string& text) {
+    if (text.find_first_of(",\"\r\n") == string::npos) return text;
+    string quoted = "\"";
+    for (char c : text) {
+        if (c == '"') quoted += '"';
+        quoted += c;
     }
-    cout << "}";
+    return quoted + "\"";
 }
 
-// Forward Selection Algorithm
-void forwardSelection(vector<Instance>& data, int totalFeatures) {
-    cout << "Running nearest neighbor with no features (default rate), using \"leave-one-out\" evaluation, I get an accuracy of "
-         << fixed << setprecision(1) << leaveOneOutValidation(data, {}) << "%" << endl;
-
-    cout << "Beginning search." << endl;
-
-    vector<int> selectedFeatures; // Track selected features
-    double bestOverallAccuracy = 0.0;
-
-    for (int i = 1; i <= totalFeatures; ++i) {
-        int bestFeature = -1;
-        double bestAccuracy = 0.0;
-
-        // Iterate through unselected features
-        for (int feature = 1; feature <= totalFeatures; ++feature) {
-            if (find(selectedFeatures.begin(), selectedFeatures.end(), feature) == selectedFeatures.end()) {
-                vector<int> tempFeatures = selectedFeatures;
-                tempFeatures.push_back(feature);
-
-                double accuracy = leaveOneOutValidation(data, tempFeatures);
-                cout << "Using feature(s) ";
-                printFeatureSet(tempFeatures);
-                cout << " accuracy is " << fixed << setprecision(1) << accuracy << "%" << endl;
-
-                if (accuracy > bestAccuracy) {
-                    bestAccuracy = accuracy;
-                    bestFeature = feature; // Update best feature
-                }
-            }
+// One row per committed step plus a "final" row per run, then one "k=N" row per --k-sweep value
+void writeBatchCsv(ostream& out, const vector<BatchRun>& runs) {
+    out << fixed << "dataset,rows,features,algorithm,step,subset,accuracy,elapsed_ms\n";
+    for (const BatchRun& run : runs) {
+        string prefix = csvField(run.dataset) + "," + to_string(run.rows) + "," + to_string(run.features) + "," + run.algorithm + ",";
+        for (size_t s = 0; s < run.result.steps.size(); ++s) {
+            const SearchStep& step = run.result.steps[s];
+            out << prefix << s + 1 << "," << featureListText(step.features) << "," << setprecision(4) << step.accuracy
+                << "," << setprecision(3) << step.milliseconds << "\n";
         }
-
-        if (bestFeature != -1) {
-            selectedFeatures.push_back(bestFeature);
-            if (bestAccuracy < bestOverallAccuracy) {
-                cout << "(Warning, Accuracy has decreased!)" << endl;
-            }
-            bestOverallAccuracy = bestAccuracy;
-
-            cout << "Feature set ";
-            printFeatureSet(selectedFeatures);
-            cout << " was best, accuracy is " << fixed << setprecision(1) << bestOverallAccuracy << "%" << endl;
-        } else {
-            break; // Stop if no features improve accuracy
+        out << prefix << "final," << featureListText(run.result.features) << "," << setprecision(4) << run.result.accuracy
+            << "," << setprecision(3) << run.searchMilliseconds << "\n";
+        for (size_t k = 0; k < run.accuracyByK.size(); ++k) {
+            out << prefix << "k=" << k + 1 << "," << featureListText(run.result.features) << "," << setprecision(4) << run.accuracyByK[k] << ",\n";
         }
     }
-
-    cout << "Finished search!! The best feature subset is ";
-    printFeatureSet(selectedFeatures);
-    cout << ", which has an accuracy of " << fixed << setprecision(1) << bestOverallAccuracy << "%" << endl;
 }
 
-// Backward Elimination Algorithm
-void backwardElimination(vector<Instance> dataset, int totalFeatures) {
-    // Start with all features
-    vector<int> selectedFeatures;
-    for (int i = 1; i <= totalFeatures; ++i) {
-        selectedFeatures.push_back(i);
+void writeBatchText(ostream& out, const vector<BatchRun>& runs) {
+    for (const BatchRun& run : runs) {
+        out << run.dataset << " (" << run.rows << " rows, " << run.features << " features) " << run.algorithm << ": "
+            << featureSetString(run.result.features) << " " << fixed << setprecision(1) << run.result.accuracy << "%, loaded in "
+            << setprecision(2) << run.loadMilliseconds << " ms, searched in " << run.searchMilliseconds << " ms\n";
+        for (size_t s = 0; s < run.result.steps.size(); ++s) {
+            const SearchStep& step = run.result.steps[s];
+            out << "  step " << s + 1 << ": " << featureSetString(step.features) << " " << setprecision(1) << step.accuracy
+                << "% at " << setprecision(2) << step.milliseconds << " ms\n";
+        }
+        if (!run.accuracyByK.empty()) {
+            out << "  accuracy by k:";
+            for (size_t k = 0; k < run.accuracyByK.size(); ++k) out << " " << k + 1 << "=" << setprecision(1) << run.accuracyByK[k] << "%";
+            out << "\n";
+        }
     }
+}
 
-    // Evaluate the full set initially
-    double bestAccuracy = leaveOneOutValidation(dataset, selectedFeatures);
-
-    cout << "Using all features and \"leave-one-out\" evaluation, I get an accuracy of "
-         << fixed << setprecision(1) << bestAccuracy << "%" << endl;
-    cout << "Beginning search." << endl;
-
-    while (selectedFeatures.size() > 1) {
-        int worstFeature = -1;  // Track the feature whose removal gives the best improvement
-        double maxAccuracy = 0; // Track the best accuracy after removing a feature
-
-        for (size_t i = 0; i < selectedFeatures.size(); ++i) {
-            int feature = selectedFeatures[i]; // Feature to evaluate removal
-
-            // Create a temporary subset without the current feature
-            vector<int> tempSet = selectedFeatures;
-            tempSet.erase(tempSet.begin() + i);
-
-            // Evaluate accuracy for the new subset
-            double accuracy = leaveOneOutValidation(dataset, tempSet);
-
-            // Print the trace for this evaluation
-            cout << "Using feature(s) ";
-            printFeatureSet(tempSet);
-            cout << " accuracy is " << fixed << setprecision(1) << accuracy << "%" << endl;
-
-            // Update the worst feature for this step if accuracy improves
-            if (accuracy > maxAccuracy) {
-                maxAccuracy = accuracy;
-                worstFeature = feature;
-            }
+// Non-interactive mode: runs every algorithm in `choices` (and the `subset`, if any) on every file, keeps the
+// searches' step-by-step traces out of the output, and writes all results in `format` once at the end.
+// Each dataset gets its own subset memo, shared by the algorithms run on it.
+// With a nonzero `streamBudgetBytes` the subset is scored straight from the file in blocks that fit the budget,
+// and the dataset is never loaded (searches are not available then).
+// A nonzero `sweepK` also scores every run's final subset for k = 1..sweepK, in one pass per subset.
+int runBatch(const vector<string>& files, const vector<int>& choices, const vector<int>& subset, const string& format,
+             const string& outputPath, bool persistMemo, size_t streamBudgetBytes, int sweepK, SearchSettings settings) {
+    vector<BatchRun> runs;
+
+    NullBuffer discard;
+    streambuf* console = cout.rdbuf(&discard);
+    for (const string& filename : files) {
+        if (streamBudgetBytes > 0) {
+            auto start = chrono::steady_clock::now();
+            StreamingReport report;
+            BatchRun run;
+            run.dataset = filename;
+            run.algorithm = "subset";
+            run.result.features = subset;
+            run.result.accuracy = streamingLeaveOneOut(filename, subset, streamBudgetBytes, *settings.pool, &report);
+            run.rows = report.numRows;
+            run.features = report.numFeatures;
+            run.searchMilliseconds = millisecondsSince(start);
+            runs.push_back(run);
+            continue;
         }
 
-        if (worstFeature != -1) {
-            // Remove the identified "worst" feature permanently
-            selectedFeatures.erase(remove(selectedFeatures.begin(), selectedFeatures.end(), worstFeature), selectedFeatures.end());
-
-            if (maxAccuracy < bestAccuracy) {
-                cout << "(Warning, Accuracy has decreased!)" << endl;
+        auto loadStart = chrono::steady_clock::now();
+        FeatureMatrix instances;
+        loadNormalizedDataset(filename, instances, settings.pool);
+        double loadMilliseconds = millisecondsSince(loadStart);
+
+        SubsetMemo memo;
+        settings.memo = &memo;
+        string memoPath = subsetMemoPath(filename, settings);
+        uint64_t datasetHash = persistMemo ? datasetContentHash(instances) : 0;
+        if (persistMemo) memo.load(memoPath, datasetHash, subsetMemoVariant(settings));
+
+        BatchRun run;
+        run.dataset = filename;
+        run.rows = instances.numRows;
+        run.features = instances.numFeatures;
+        run.loadMilliseconds = loadMilliseconds;
+
+        if (!subset.empty()) {
+            if (*max_element(subset.begin(), subset.end()) > static_cast<int>(instances.numFeatures)) {
+                cout.rdbuf(console);
+                cerr << "Error: " << filename << " has only " << instances.numFeatures << " features" << endl;
+                exit(1);
             }
-
-            bestAccuracy = maxAccuracy;
-
-            cout << "Feature set ";
-            printFeatureSet(selectedFeatures);
-            cout << " was best, accuracy is " << fixed << setprecision(1) << bestAccuracy << "%" << endl;
-        } else {
-            cout << "No further improvements possible." << endl;
-            break;
+            auto start = chrono::steady_clock::now();
+            run.algorithm = "subset";
+            run.result.features = subset;
+            run.result.accuracy = subsetAccuracyAtPrecision(instances, subset, settings);
+            run.searchMilliseconds = millisecondsSince(start);
+            if (sweepK > 0) run.accuracyByK = accuracyByKAtPrecision(instances, subset, sweepK, settings);
+            runs.push_back(run);
+        }
+        for (int choice : choices) {
+            auto start = chrono::steady_clock::now();
+            bool valid;
+            run.algorithm = searchName(choice);
+            run.result = runSearchAtPrecision(instances, settings.precision, choice, settings, valid);
+            if (run.result.failed) continue; // Reported already; the other searches and datasets still run
+            run.searchMilliseconds = millisecondsSince(start);
+            if (sweepK > 0) run.accuracyByK = accuracyByKAtPrecision(instances, run.result.features, sweepK, settings);
+            runs.push_back(run);
         }
+        if (persistMemo) memo.save(memoPath, datasetHash, subsetMemoVariant(settings));
     }
-
-    // Final output: Best feature subset and its accuracy
-    cout << "Finished search!! The best feature subset is ";
-    printFeatureSet(selectedFeatures);
-    cout << ", which has an accuracy of " << fixed << setprecision(1) << bestAccuracy << "%" << endl;
+    cout.rdbuf(console);
+
+    ofstream outputFile;
+    if (!outputPath.empty()) {
+        outputFile.open(outputPath);
+        if (!outputFile.is_open()) {
+            cerr << "Error: Unable to open file " << outputPath << endl;
+            return 1;
+        }
+    }
+    ostream& out = outputPath.empty() ? cout : outputFile;
+    if (format == "json") writeBatchJson(out, runs);
+    else if (format == "csv") writeBatchCsv(out, runs);
+    else writeBatchText(out, runs);
+    out.flush();
+    return out ? 0 : 1;
 }
 
-// Bidirectional search combines forward selection and backward elimination
-void bidirectionalSearch(vector<Instance>& data, int totalFeatures) {
-    cout << "Starting Bidirectional Search..." << endl;
-
-    vector<int> forwardSelectedFeatures; // Features selected during forward selection
-    vector<int> backwardSelectedFeatures;
-    for (int i = 1; i <= totalFeatures; ++i) {
-        backwardSelectedFeatures.push_back(i); // Initialize with all features
+// Prediction mode: loads and normalizes `trainingFilename` once, then labels every row of `queryFilename` with the
+// 1-NN rule over `subset`, streaming one label per line to `outputPath` (stdout if empty). The summary goes to
+// stderr so the labels can be piped on.
+int runPrediction(const string& trainingFilename, const vector<int>& subset, const string& queryFilename, const string& outputPath, ThreadPool& pool) {
+    auto loadStart = chrono::steady_clock::now();
+    FeatureMatrix training;
+    loadNormalizedDataset(trainingFilename, training, &pool);
+    double loadMilliseconds = millisecondsSince(loadStart);
+    if (*max_element(subset.begin(), subset.end()) > static_cast<int>(training.numFeatures)) {
+        cerr << "Error: " << trainingFilename << " has only " << training.numFeatures << " features" << endl;
+        return 1;
     }
 
-    double bestAccuracy = leaveOneOutValidation(data, {}); // Initial accuracy with no features
-    vector<int> bestFeatureSet;
-
-    while (!backwardSelectedFeatures.empty() || forwardSelectedFeatures.size() < totalFeatures) {
-        int bestFeatureToAdd = -1, bestFeatureToRemove = -1;
-        double bestForwardAccuracy = 0.0, bestBackwardAccuracy = 0.0;
-
-        // Forward selection step
-        for (int feature = 1; feature <= totalFeatures; ++feature) {
-            if (find(forwardSelectedFeatures.begin(), forwardSelectedFeatures.end(), feature) == forwardSelectedFeatures.end()) {
-                vector<int> tempFeatures = forwardSelectedFeatures;
-                tempFeatures.push_back(feature);
-
-                double accuracy = leaveOneOutValidation(data, tempFeatures);
-                if (accuracy > bestForwardAccuracy) {
-                    bestForwardAccuracy = accuracy;
-                    bestFeatureToAdd = feature; // Feature to add
-                }
-            }
-        }
-
-        // Backward elimination step
-        for (size_t i = 0; i < backwardSelectedFeatures.size(); ++i) {
-            vector<int> tempFeatures = backwardSelectedFeatures;
-            tempFeatures.erase(tempFeatures.begin() + i);
-
-            double accuracy = leaveOneOutValidation(data, tempFeatures);
-            if (accuracy > bestBackwardAccuracy) {
-                bestBackwardAccuracy = accuracy;
-                bestFeatureToRemove = backwardSelectedFeatures[i]; // Feature to remove
-            }
+    ofstream outputFile;
+    if (!outputPath.empty()) {
+        outputFile.open(outputPath);
+        if (!outputFile.is_open()) {
+            cerr << "Error: Unable to open file " << outputPath << endl;
+            return 1;
         }
+    }
+    ostream& out = outputPath.empty() ? cout : outputFile;
 
-        // Decide the better action (add or remove)
-        if (bestForwardAccuracy > bestBackwardAccuracy) {
-            forwardSelectedFeatures.push_back(bestFeatureToAdd);
-            backwardSelectedFeatures.erase(remove(backwardSelectedFeatures.begin(), backwardSelectedFeatures.end(), bestFeatureToAdd), backwardSelectedFeatures.end());
-            bestAccuracy = bestForwardAccuracy;
-            bestFeatureSet = forwardSelectedFeatures;
-            cout << "Added feature " << bestFeatureToAdd << ", accuracy: " << fixed << setprecision(1) << bestAccuracy << "%" << endl;
-        } else if (bestBackwardAccuracy >= bestForwardAccuracy) {
-            backwardSelectedFeatures.erase(remove(backwardSelectedFeatures.begin(), backwardSelectedFeatures.end(), bestFeatureToRemove), backwardSelectedFeatures.end());
-            forwardSelectedFeatures.erase(remove(forwardSelectedFeatures.begin(), forwardSelectedFeatures.end(), bestFeatureToRemove), forwardSelectedFeatures.end());
-            bestAccuracy = bestBackwardAccuracy;
-            bestFeatureSet = backwardSelectedFeatures;
-            cout << "Removed feature " << bestFeatureToRemove << ", accuracy: " << fixed << setprecision(1) << bestAccuracy << "%" << endl;
-        } else {
-            break; // Exit if neither action improves accuracy
-        }
+    PredictionModel model = buildPredictionModel(training, subset);
+    PredictionReport report = predictFile(model, queryFilename, out, pool);
+    if (!out) {
+        cerr << "Error: Unable to write the predictions" << endl;
+        return 1;
     }
 
-    cout << "Finished Bidirectional Search! Best feature subset: ";
-    printFeatureSet(bestFeatureSet);
-    cout << " with accuracy: " << fixed << setprecision(1) << bestAccuracy << "%" << endl;
+    cerr << fixed << setprecision(2) << "Training set " << trainingFilename << " (" << training.numRows << " rows) loaded in "
+         << loadMilliseconds << " ms; subset " << featureSetString(subset) << " searched with "
+         << (report.usedGemm ? "gemm" : "the column scan") << endl;
+    cerr << "Predicted " << report.numRows << " rows in " << report.numBlocks << " blocks in " << report.totalMilliseconds << " ms ("
+         << setprecision(0) << report.queriesPerSecond() << " queries/sec; nearest-neighbor search " << setprecision(2)
+         << report.searchMilliseconds << " ms)" << endl;
+    if (report.numRows > 0) {
+        cerr << setprecision(1) << static_cast<double>(report.labelMatches) / report.numRows * 100.0
+             << "% of predictions match the file's label column" << endl;
+    }
+    return 0;
 }
 
 // Exports selected features to a CSV file
-void exportSelectedFeatures(const vector<Instance>& instances, const vector<int>& selectedFeatures, const string& filename) {
+void exportSelectedFeatures(const FeatureMatrix& instances, const vector<int>& selectedFeatures, const string& filename) {
     ofstream file(filename);
     if (!file.is_open()) {
         cerr << "Error: Unable to open file for writing." << endl;
@@ -381,12 +483,12 @@ void exportSelectedFeatures(const vector<Instance>& instances, const vector<int>
     file << ",Label" << endl;
 
     // Write feature values and class labels
-    for (const auto& instance : instances) {
+    for (size_t row = 0; row < instances.numRows; ++row) {
         for (size_t i = 0; i < selectedFeatures.size(); ++i) {
-            file << instance.features[selectedFeatures[i] - 1]; // Convert 1-based index to 0-based
+            file << instances.at(row, selectedFeatures[i] - 1); // Convert 1-based index to 0-based
             if (i < selectedFeatures.size() - 1) file << ",";
         }
-        file << "," << instance.label << endl; // Add label
+        file << "," << instances.labels[row] << endl; // Add label
     }
 
     file.close();
@@ -394,25 +496,187 @@ void exportSelectedFeatures(const vector<Instance>& instances, const vector<int>
 }
 
 // Main function to drive the feature selection process
-int main() {
+// Usage: ./a.out [--threads N] [--nn auto|brute|early|kd|vp|gemm] [--precision f64|f32|i16|i8] [--memo] [--bounded]
+//               [--profile] [--trace FILE] [--k K] [--vote majority|weighted] [--racing] [--confidence C] [--seed N]
+//               [--beam-width B] [--top N] [--max-cache-mb N]
+//               [--precision-report FILE...] [--racing-report FILE...]
+//               [--data FILE... [--algo forward,backward,bidir,sffs,beam,exhaustive] [--features 1,2,...] [--output text|json|csv] [--out FILE]
+//                [--stream MB] [--k-sweep K]]
+//               [--data FILE --features 1,2,... --predict QUERYFILE [--out FILE]]
+//               [--data FILE --features 1,2,... --serve SOCKET]
+int main(int argc, char* argv[]) {
     srand(static_cast<unsigned int>(time(0))); // Seed random number generator for consistent results
 
-    vector<Instance> instances; // Dataset instances
+    // Candidate evaluations and their held-out rows run on this many threads (default: every core)
+    int numThreads = max(1u, thread::hardware_concurrency());
+    SearchSettings settings;
+    vector<string> reportFiles; // Datasets for --precision-report
+    vector<string> racingReportFiles; // Datasets for --racing-report
+    bool persistMemo = false;   // Keep scored subsets in "<file>.<precision>.memo" across runs
+    int sweepK = 0;             // --k-sweep: also score each final subset for k = 1..sweepK
+    bool printProfile = false;  // Print the per-step counter summary after the search
+    string tracePath;           // Write a Chrome trace-event timeline here
+    vector<string> batchFiles;  // --data: run without prompts over these datasets
+    vector<int> batchChoices;   // --algo
+    vector<int> batchSubset;    // --features
+    string batchFormat = "text";
+    string batchOutputPath;
+    double streamMegabytes = 0.0; // --stream: block budget for scoring --features without loading the file
+    string predictPath;         // --predict: label this file's rows from --data and --features
+    string servePath;           // --serve: answer predictions for --data and --features on this socket
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            numThreads = max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--nn") == 0 && i + 1 < argc && parseNeighborMethod(argv[i + 1], settings.neighborMethod)) {
+            ++i;
+        } else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc && parseFeaturePrecision(argv[i + 1], settings.precision)) {
+            ++i;
+        } else if (strcmp(argv[i], "--precision-report") == 0 && i + 1 < argc) {
+            while (i + 1 < argc && argv[i + 1][0] != '-') reportFiles.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--racing-report") == 0 && i + 1 < argc) {
+            while (i + 1 < argc && argv[i + 1][0] != '-') racingReportFiles.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--racing") == 0) {
+            settings.racing.enabled = true;
+        } else if (strcmp(argv[i], "--confidence") == 0 && i + 1 < argc && atof(argv[i + 1]) > 0.0 && atof(argv[i + 1]) < 1.0) {
+            settings.racing.confidence = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            settings.racing.seed = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--max-cache-mb") == 0 && i + 1 < argc && atof(argv[i + 1]) >= 0.0) {
+            settings.maxCacheBytes = atof(argv[++i]) * (1 << 20);
+        } else if (strcmp(argv[i], "--beam-width") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 1) {
+            settings.beamWidth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--top") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 1) {
+            settings.topSubsets = static_cast<size_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--memo") == 0) {
+            persistMemo = true;
+        } else if (strcmp(argv[i], "--bounded") == 0) {
+            settings.bounded = true;
+        } else if (strcmp(argv[i], "--k") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 1) {
+            settings.vote.k = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--vote") == 0 && i + 1 < argc && parseVoteRule(argv[i + 1], settings.vote.rule)) {
+            ++i;
+        } else if (strcmp(argv[i], "--k-sweep") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 1) {
+            sweepK = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            printProfile = true;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (strcmp(argv[i], "--data") == 0 && i + 1 < argc) {
+            while (i + 1 < argc && argv[i + 1][0] != '-') batchFiles.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--algo") == 0 && i + 1 < argc && parseAlgorithmList(argv[i + 1], batchChoices)) {
+            ++i;
+        } else if (strcmp(argv[i], "--features") == 0 && i + 1 < argc && parseFeatureList(argv[i + 1], batchSubset)) {
+            ++i;
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc
+                   && (strcmp(argv[i + 1], "text") == 0 || strcmp(argv[i + 1], "json") == 0 || strcmp(argv[i + 1], "csv") == 0)) {
+            batchFormat = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            batchOutputPath = argv[++i];
+        } else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc && atof(argv[i + 1]) > 0.0) {
+            streamMegabytes = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--predict") == 0 && i + 1 < argc) {
+            predictPath = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            servePath = argv[++i];
+        } else {
+            cerr << "Usage: " << argv[0] << " [--threads N] [--nn auto|brute|early|kd|vp|gemm] [--precision f64|f32|i16|i8]"
+                 << " [--memo] [--bounded] [--profile] [--trace FILE] [--k K] [--vote majority|weighted]"
+                 << " [--racing] [--confidence C] [--seed N] [--beam-width B] [--top N] [--max-cache-mb N] [--precision-report FILE...] [--racing-report FILE...]"
+                 << " [--data FILE... [--algo forward,backward,bidir,sffs,beam,exhaustive] [--features 1,2,...] [--output text|json|csv] [--out FILE]"
+                 << " [--stream MB] [--k-sweep K]] [--data FILE --features 1,2,... --predict QUERYFILE [--out FILE]]"
+                 << " [--data FILE --features 1,2,... --serve SOCKET]" << endl;
+            return 1;
+        }
+    }
+    instrumentationEnabled = printProfile || !tracePath.empty(); // Set before any thread starts counting
+    ThreadPool pool(numThreads);
+    settings.pool = &pool;
+
+    if (!reportFiles.empty()) {
+        printPrecisionReport(reportFiles, settings);
+        return 0;
+    }
+    if (!racingReportFiles.empty()) {
+        printRacingReport(racingReportFiles, settings);
+        return 0;
+    }
+
+    if (!servePath.empty()) {
+        if (batchFiles.size() != 1 || batchSubset.empty() || !batchChoices.empty() || !predictPath.empty() || streamMegabytes > 0.0) {
+            cerr << "Error: --serve needs one --data training file and a --features subset to start with" << endl;
+            return 1;
+        }
+        if (!settings.vote.isOneNearest()) {
+            cerr << "Error: --serve only predicts with 1-NN" << endl;
+            return 1;
+        }
+        FeatureMatrix training;
+        loadNormalizedDataset(batchFiles[0], training, &pool);
+        if (*max_element(batchSubset.begin(), batchSubset.end()) > static_cast<int>(training.numFeatures)) {
+            cerr << "Error: " << batchFiles[0] << " has only " << training.numFeatures << " features" << endl;
+            return 1;
+        }
+        return runPredictionServer(servePath, training, batchSubset, pool);
+    }
+
+    if (!predictPath.empty()) {
+        if (batchFiles.size() != 1 || batchSubset.empty() || !batchChoices.empty() || streamMegabytes > 0.0) {
+            cerr << "Error: --predict needs one --data training file and a --features subset" << endl;
+            return 1;
+        }
+        if (!settings.vote.isOneNearest()) {
+            cerr << "Error: --predict only predicts with 1-NN" << endl;
+            return 1;
+        }
+        int status = runPrediction(batchFiles[0], batchSubset, predictPath, batchOutputPath, pool);
+        if (printProfile) profiler().printStepSummary(cerr);
+        if (!tracePath.empty() && !profiler().writeTrace(tracePath)) {
+            cerr << "Error: Unable to write trace file " << tracePath << endl;
+        }
+        return status;
+    }
+
+    if (!batchFiles.empty()) {
+        if (streamMegabytes > 0.0 && (batchSubset.empty() || !batchChoices.empty())) {
+            cerr << "Error: --stream scores one --features subset; the searches need the dataset in memory" << endl;
+            return 1;
+        }
+        if (streamMegabytes > 0.0 && (!settings.vote.isOneNearest() || sweepK > 0)) {
+            cerr << "Error: --stream only scores 1-NN" << endl;
+            return 1;
+        }
+        if (batchChoices.empty() && batchSubset.empty()) batchChoices = {1, 2, 3};
+        size_t streamBudgetBytes = static_cast<size_t>(streamMegabytes * (1 << 20));
+        int status = runBatch(batchFiles, batchChoices, batchSubset, batchFormat, batchOutputPath, persistMemo, streamBudgetBytes, sweepK, settings);
+        if (printProfile) profiler().printStepSummary(cerr); // Keeps stdout machine-readable
+        if (!tracePath.empty() && !profiler().writeTrace(tracePath)) {
+            cerr << "Error: Unable to write trace file " << tracePath << endl;
+        }
+        return status;
+    }
+
+    FeatureMatrix instances; // Dataset instances, stored column by column
     string datasetFilename;
 
     cout << "Welcome to Joe's and Yahir's Feature Selection Algorithm." << endl;
     cout << "Type in the name of the file to test: ";
     cin >> datasetFilename;
 
-    parseDataset(datasetFilename, instances); // Parse dataset from file
-    normalizeFeatures(instances); // Normalize feature values
+    loadNormalizedDataset(datasetFilename, instances, &pool); // Parse and normalize the file, or map its binary cache
 
-    int totalFeatures = instances[0].features.size(); // Number of features in the dataset
+    // Subsets scored during this run are never scored twice; with --memo, neither are those from earlier runs
+    // on the same dataset contents and precision
+    SubsetMemo memo;
+    settings.memo = &memo;
+    string memoPath = subsetMemoPath(datasetFilename, settings);
+    uint64_t datasetHash = persistMemo ? datasetContentHash(instances) : 0;
+    if (persistMemo) memo.load(memoPath, datasetHash, subsetMemoVariant(settings));
 
     cout << "Type the number of the algorithm you want to run." << endl << endl;
-    cout << "1. Forward Selection" << endl;
-    cout << "2. Backward Elimination" << endl;
-    cout << "3. Custom Bidirectional Algorithm" << endl;
+    const auto& strategies = searchStrategies<FeatureMatrix>();
+    for (size_t s = 0; s < strategies.size(); ++s) {
+        cout << s + 1 << ". " << strategies[s].title << endl;
+    }
 
     int choice;
     cin >> choice;
@@ -420,16 +684,26 @@ int main() {
     cout << endl << endl;
 
     // Run the selected algorithm
-    if (choice == 1) {
-        forwardSelection(instances, totalFeatures);
-    } else if (choice == 2) {
-        backwardElimination(instances, totalFeatures);
-    } else if (choice == 3) {
-        bidirectionalSearch(instances, totalFeatures);
-    } else {
+    bool valid;
+    SearchResult result = runSearchAtPrecision(instances, settings.precision, choice, settings, valid);
+    if (!valid) {
         cout << "Invalid choice. Exiting." << endl;
         return 1;
     }
+    if (result.failed) return 1;
+    if (persistMemo) {
+        memo.save(memoPath, datasetHash, subsetMemoVariant(settings));
+        cout << "Subset memo: " << memo.hits() << " hits, " << memo.misses() << " misses, "
+             << memo.size() << " subsets saved to " << memoPath << endl;
+    }
+    if (printProfile) {
+        cout << endl;
+        profiler().printStepSummary(cout);
+    }
+    if (!tracePath.empty()) {
+        if (profiler().writeTrace(tracePath)) cout << "Trace written to " << tracePath << endl;
+        else cerr << "Error: Unable to write trace file " << tracePath << endl;
+    }
     //exportSelectedFeatures(instances, {2, 1}, "good_features.csv"); // Features that separate well
     //exportSelectedFeatures(instances, {3, 6}, "bad_features.csv"); // Features that don’t separate well
     return 0;
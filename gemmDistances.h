@@ -0,0 +1,333 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cstddef>
+#include <immintrin.h> // AVX2 / AVX-512 intrinsics
+
+#include "featureMatrix.h"
+#include "instrumentation.h"
+
+using namespace std;
+
+// Nearest neighbors of a block of held-out rows through the identity |a - b|^2 = |a|^2 + |b|^2 - 2 a.b.
+// The dot products are a matrix multiply of the held-out rows with the training rows, computed in register
+// tiles of GEMM_QUERY_TILE x GEMM_ROW_TILE: each feature costs one load of a training row segment and one
+// broadcast per held-out row, where the column scan reads and rewrites a whole distance row per feature.
+// Training rows are walked in blocks of GEMM_ROW_BLOCK, packed tile by tile so a tile's features are contiguous
+// (columns of the same rows sit a whole column apart and would evict each other from L1), and the packed block
+// stays in cache while every tile of held-out rows passes over it. Each tile's epilogue folds its distances into
+// a running minimum per held-out row, so no distance row or n x n matrix is ever stored.
+// The identity rounds differently from summing squared differences, so every row within a held-out row's
+// tolerance (gemmTolerance) of the minimum is kept and finally re-measured directly in subset order; the chosen
+// neighbor and its distance are then exactly the ones the column scan finds (lowest index on ties).
+
+const size_t GEMM_QUERY_TILE = 4;  // Held-out rows per register tile
+const size_t GEMM_ROW_TILE = 16;   // Training rows per register tile
+const size_t GEMM_ROW_BLOCK = 256; // Training rows per cache block
+
+// Subsets narrower than this stay with the column scan: with few features the tile epilogue costs more than
+// the loads it saves (measured with kernelBenchmark; see readme)
+const size_t GEMM_MIN_WIDTH = 4;
+
+// Identity distances this close to the smallest one are always re-measured directly
+const double GEMM_TIE_TOLERANCE = 1e-9;
+
+// Rounding allowed per feature and unit of squared norm. The identity and the column scan each round by at most a
+// few machine epsilons per feature times the squared norms involved, and the shortlist has to cover both errors
+// for two rows, so this bounds how far the scan's nearest row can sit above the identity's minimum.
+const double GEMM_ROUNDING_PER_FEATURE = 8.0 * numeric_limits<double>::epsilon();
+
+// Subset columns and per-row squared norms, prepared once per subset
+struct GemmLayout {
+    vector<const double*> columns; // Subset columns in subset order
+    vector<double> rowNorms;       // |row|^2 over the subset
+    double maxRowNorm = 0.0;
+};
+
+inline GemmLayout buildGemmLayout(const FeatureMatrix& data, const vector<int>& features) {
+    GemmLayout layout;
+    for (int feature : features) layout.columns.push_back(data.column(feature - 1));
+    layout.rowNorms.assign(data.numRows, 0.0);
+    for (const double* column : layout.columns) {
+        for (size_t row = 0; row < data.numRows; ++row) layout.rowNorms[row] += column[row] * column[row];
+    }
+    for (double norm : layout.rowNorms) layout.maxRowNorm = max(layout.maxRowNorm, norm);
+    return layout;
+}
+
+// One register tile: distances[q * GEMM_ROW_TILE + r] = queryNorms[q] + rowNorms[r] - 2 * dot(query q, row r)
+// and tileMin[q] the smallest of query q's distances. Both sides are packed feature-major:
+// queryValues[k * GEMM_QUERY_TILE + q] and rowValues[k * GEMM_ROW_TILE + r].
+struct GemmKernels {
+    const char* name;
+    void (*tile)(const double* rowValues, size_t width, const double* queryValues, const double* queryNorms,
+                 const double* rowNorms, double* distances, double* tileMin);
+};
+
+inline void gemmTileScalar(const double* rowValues, size_t width, const double* queryValues, const double* queryNorms,
+                           const double* rowNorms, double* distances, double* tileMin) {
+    double dots[GEMM_QUERY_TILE][GEMM_ROW_TILE] = {};
+    for (size_t k = 0; k < width; ++k) {
+        const double* column = rowValues + k * GEMM_ROW_TILE;
+        for (size_t q = 0; q < GEMM_QUERY_TILE; ++q) {
+            double a = queryValues[k * GEMM_QUERY_TILE + q];
+            for (size_t r = 0; r < GEMM_ROW_TILE; ++r) dots[q][r] += a * column[r];
+        }
+    }
+    for (size_t q = 0; q < GEMM_QUERY_TILE; ++q) {
+        tileMin[q] = numeric_limits<double>::infinity();
+        for (size_t r = 0; r < GEMM_ROW_TILE; ++r) {
+            double distance = queryNorms[q] + rowNorms[r] - 2.0 * dots[q][r];
+            distances[q * GEMM_ROW_TILE + r] = distance;
+            tileMin[q] = min(tileMin[q], distance);
+        }
+    }
+}
+
+// Two passes of 4 held-out rows x 8 training rows. The accumulators are named one by one: GCC at -O2 does not
+// unroll the loop over held-out rows, and an indexed array of them would live on the stack.
+__attribute__((target("avx2,fma")))
+inline void gemmTileAvx2(const double* rowValues, size_t width, const double* queryValues, const double* queryNorms,
+                         const double* rowNorms, double* distances, double* tileMin) {
+    static_assert(GEMM_QUERY_TILE == 4 && GEMM_ROW_TILE == 16, "the AVX2 tile is written out for 4 x 16");
+    __m256d minimum[GEMM_QUERY_TILE];
+    for (size_t half = 0; half < GEMM_ROW_TILE; half += 8) {
+        __m256d a00 = _mm256_setzero_pd(), a01 = a00, a10 = a00, a11 = a00, a20 = a00, a21 = a00, a30 = a00, a31 = a00;
+        const double* b = rowValues + half;
+        const double* a = queryValues;
+        for (size_t k = 0; k < width; ++k, b += GEMM_ROW_TILE, a += GEMM_QUERY_TILE) {
+            __m256d b0 = _mm256_loadu_pd(b), b1 = _mm256_loadu_pd(b + 4);
+            __m256d q0 = _mm256_broadcast_sd(a), q1 = _mm256_broadcast_sd(a + 1);
+            __m256d q2 = _mm256_broadcast_sd(a + 2), q3 = _mm256_broadcast_sd(a + 3);
+            a00 = _mm256_fmadd_pd(q0, b0, a00);
+            a01 = _mm256_fmadd_pd(q0, b1, a01);
+            a10 = _mm256_fmadd_pd(q1, b0, a10);
+            a11 = _mm256_fmadd_pd(q1, b1, a11);
+            a20 = _mm256_fmadd_pd(q2, b0, a20);
+            a21 = _mm256_fmadd_pd(q2, b1, a21);
+            a30 = _mm256_fmadd_pd(q3, b0, a30);
+            a31 = _mm256_fmadd_pd(q3, b1, a31);
+        }
+        __m256d acc[GEMM_QUERY_TILE][2] = {{a00, a01}, {a10, a11}, {a20, a21}, {a30, a31}};
+        __m256d minusTwo = _mm256_set1_pd(-2.0);
+        __m256d n0 = _mm256_loadu_pd(rowNorms + half), n1 = _mm256_loadu_pd(rowNorms + half + 4);
+        for (size_t q = 0; q < GEMM_QUERY_TILE; ++q) {
+            __m256d queryNorm = _mm256_set1_pd(queryNorms[q]);
+            __m256d d0 = _mm256_fmadd_pd(minusTwo, acc[q][0], _mm256_add_pd(queryNorm, n0));
+            __m256d d1 = _mm256_fmadd_pd(minusTwo, acc[q][1], _mm256_add_pd(queryNorm, n1));
+            _mm256_storeu_pd(distances + q * GEMM_ROW_TILE + half, d0);
+            _mm256_storeu_pd(distances + q * GEMM_ROW_TILE + half + 4, d1);
+            __m256d halfMin = _mm256_min_pd(d0, d1);
+            minimum[q] = half == 0 ? halfMin : _mm256_min_pd(minimum[q], halfMin);
+        }
+    }
+    for (size_t q = 0; q < GEMM_QUERY_TILE; ++q) {
+        double lanes[4];
+        _mm256_storeu_pd(lanes, minimum[q]);
+        tileMin[q] = min(min(lanes[0], lanes[1]), min(lanes[2], lanes[3]));
+    }
+}
+
+// 4 held-out rows x 16 training rows in eight zmm accumulators, named one by one like the AVX2 tile
+__attribute__((target("avx512f")))
+inline void gemmTileAvx512(const double* rowValues, size_t width, const double* queryValues, const double* queryNorms,
+                           const double* rowNorms, double* distances, double* tileMin) {
+    static_assert(GEMM_QUERY_TILE == 4 && GEMM_ROW_TILE == 16, "the AVX-512 tile is written out for 4 x 16");
+    __m512d a00 = _mm512_setzero_pd(), a01 = a00, a10 = a00, a11 = a00, a20 = a00, a21 = a00, a30 = a00, a31 = a00;
+    const double* b = rowValues;
+    const double* a = queryValues;
+    for (size_t k = 0; k < width; ++k, b += GEMM_ROW_TILE, a += GEMM_QUERY_TILE) {
+        __m512d b0 = _mm512_loadu_pd(b), b1 = _mm512_loadu_pd(b + 8);
+        __m512d q0 = _mm512_set1_pd(a[0]), q1 = _mm512_set1_pd(a[1]), q2 = _mm512_set1_pd(a[2]), q3 = _mm512_set1_pd(a[3]);
+        a00 = _mm512_fmadd_pd(q0, b0, a00);
+        a01 = _mm512_fmadd_pd(q0, b1, a01);
+        a10 = _mm512_fmadd_pd(q1, b0, a10);
+        a11 = _mm512_fmadd_pd(q1, b1, a11);
+        a20 = _mm512_fmadd_pd(q2, b0, a20);
+        a21 = _mm512_fmadd_pd(q2, b1, a21);
+        a30 = _mm512_fmadd_pd(q3, b0, a30);
+        a31 = _mm512_fmadd_pd(q3, b1, a31);
+    }
+    __m512d acc[GEMM_QUERY_TILE][2] = {{a00, a01}, {a10, a11}, {a20, a21}, {a30, a31}};
+    __m512d minusTwo = _mm512_set1_pd(-2.0);
+    __m512d n0 = _mm512_loadu_pd(rowNorms), n1 = _mm512_loadu_pd(rowNorms + 8);
+    for (size_t q = 0; q < GEMM_QUERY_TILE; ++q) {
+        __m512d queryNorm = _mm512_set1_pd(queryNorms[q]);
+        __m512d d0 = _mm512_fmadd_pd(minusTwo, acc[q][0], _mm512_add_pd(queryNorm, n0));
+        __m512d d1 = _mm512_fmadd_pd(minusTwo, acc[q][1], _mm512_add_pd(queryNorm, n1));
+        _mm512_storeu_pd(distances + q * GEMM_ROW_TILE, d0);
+        _mm512_storeu_pd(distances + q * GEMM_ROW_TILE + 8, d1);
+        double lanes[8];
+        _mm512_storeu_pd(lanes, _mm512_maskz_min_pd(0xFF, d0, d1)); // maskz form avoids a GCC 12 false warning
+        tileMin[q] = *min_element(lanes, lanes + 8);
+    }
+}
+
+// Every tile kernel this CPU can run, slowest first
+inline vector<GemmKernels> availableGemmKernels() {
+    vector<GemmKernels> kernels = {{"scalar", gemmTileScalar}};
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) kernels.push_back({"avx2", gemmTileAvx2});
+    if (__builtin_cpu_supports("avx512f")) kernels.push_back({"avx512", gemmTileAvx512});
+    return kernels;
+}
+
+inline const GemmKernels& gemmKernels() {
+    static const GemmKernels selected = availableGemmKernels().back();
+    return selected;
+}
+
+// Squared distance between a query (its subset values in subset order) and row b, summed in subset order the
+// way the column scan sums it
+__attribute__((optimize("fp-contract=off")))
+inline double directSquaredDistance(const GemmLayout& layout, const double* query, size_t b) {
+    double distance = 0.0;
+    for (size_t k = 0; k < layout.columns.size(); ++k) {
+        double diff = query[k] - layout.columns[k][b];
+        distance += diff * diff;
+    }
+    return distance;
+}
+
+// How far above the identity's minimum a held-out row's nearest row by the column scan can lie. The error grows
+// with the squared norms, so it is absolute only for rows inside the training range ([0, 1] after normalization);
+// new rows normalized with a training set's ranges can lie far outside it.
+inline double gemmTolerance(const GemmLayout& layout, double queryNorm) {
+    return GEMM_TIE_TOLERANCE + GEMM_ROUNDING_PER_FEATURE * (layout.columns.size() + 1) * (queryNorm + layout.maxRowNorm);
+}
+
+// Running state of one held-out row: the smallest identity distance so far and every row that came within
+// `tolerance` of the minimum at the time it was seen, in row order
+struct GemmQueryState {
+    double best = numeric_limits<double>::infinity();
+    double tolerance = GEMM_TIE_TOLERANCE;
+    vector<pair<double, size_t>> candidates;
+    size_t prunedSize = 0; // Candidate count after the last pruning
+
+    void offer(double distance, size_t row) {
+        if (distance > best + tolerance) return;
+        best = min(best, distance);
+        candidates.push_back({distance, row});
+        if (candidates.size() > 2 * prunedSize + 32) { // Drop candidates the minimum has since moved away from
+            double bound = best + tolerance;
+            candidates.erase(remove_if(candidates.begin(), candidates.end(), [bound](const pair<double, size_t>& c) { return c.first > bound; }),
+                             candidates.end());
+            prunedSize = candidates.size();
+        }
+    }
+};
+
+// Nearest neighbor among the `numRows` rows of `layout` of each of `count` queries, where queryValue(q, k) is query
+// q's value of the k-th subset feature. With `excluded`, query q never matches row excluded[q] (a held-out row's
+// own row) and nearest[q] stays excluded[q] if no other row exists; without it nearest[q] is numRows then.
+template <typename QueryValue>
+void findNearestGemmQueries(const GemmLayout& layout, size_t numRows, size_t count, QueryValue queryValue, const size_t* excluded,
+                            size_t* nearest, double* nearestSquared) {
+    const GemmKernels& kernels = gemmKernels();
+    size_t width = layout.columns.size();
+    size_t numTiles = (count + GEMM_QUERY_TILE - 1) / GEMM_QUERY_TILE;
+
+    // Held-out rows packed per tile, feature-major; a partial last tile repeats its first row
+    thread_local vector<double> packed, queryNorms;
+    thread_local vector<GemmQueryState> states;
+    packed.assign(numTiles * width * GEMM_QUERY_TILE, 0.0);
+    queryNorms.assign(numTiles * GEMM_QUERY_TILE, 0.0);
+    if (states.size() < count) states.resize(count);
+    for (size_t q = 0; q < count; ++q) {
+        states[q].best = numeric_limits<double>::infinity();
+        states[q].candidates.clear();
+        states[q].prunedSize = 0;
+    }
+    for (size_t slot = 0; slot < numTiles * GEMM_QUERY_TILE; ++slot) {
+        size_t query = slot < count ? slot : slot - slot % GEMM_QUERY_TILE;
+        size_t tile = slot / GEMM_QUERY_TILE, q = slot % GEMM_QUERY_TILE;
+        for (size_t k = 0; k < width; ++k) { // Summed in subset order, like the row norms
+            double value = queryValue(query, k);
+            packed[(tile * width + k) * GEMM_QUERY_TILE + q] = value;
+            queryNorms[slot] += value * value;
+        }
+        if (slot < count) states[slot].tolerance = gemmTolerance(layout, queryNorms[slot]);
+    }
+
+    // Folds one tile's distances into the running minima, unless none of them can matter
+    double distances[GEMM_QUERY_TILE * GEMM_ROW_TILE];
+    double tileMin[GEMM_QUERY_TILE];
+    auto epilogue = [&](size_t tile, size_t row, size_t rowsInTile) {
+        for (size_t q = 0; q < GEMM_QUERY_TILE; ++q) {
+            size_t slot = tile * GEMM_QUERY_TILE + q;
+            if (slot >= count) break;
+            GemmQueryState& state = states[slot];
+            size_t skip = excluded != nullptr ? excluded[slot] : numRows;
+            bool ownRow = skip >= row && skip < row + rowsInTile; // Its ~0 self-distance is in the tile
+            if (!ownRow && tileMin[q] > state.best + state.tolerance) continue;
+            for (size_t r = 0; r < rowsInTile; ++r) {
+                if (row + r != skip) state.offer(distances[q * GEMM_ROW_TILE + r], row + r);
+            }
+        }
+    };
+
+    // Each block of training rows is packed once, zero-padded to whole tiles, and then met by every query tile
+    thread_local vector<double> packedRows, packedNorms;
+    packedRows.resize(GEMM_ROW_BLOCK * width);
+    packedNorms.resize(GEMM_ROW_BLOCK);
+    for (size_t blockStart = 0; blockStart < numRows; blockStart += GEMM_ROW_BLOCK) {
+        size_t blockRows = min(GEMM_ROW_BLOCK, numRows - blockStart);
+        size_t rowTiles = (blockRows + GEMM_ROW_TILE - 1) / GEMM_ROW_TILE;
+        for (size_t r = 0; r < rowTiles * GEMM_ROW_TILE; ++r) {
+            size_t tile = r / GEMM_ROW_TILE, lane = r % GEMM_ROW_TILE;
+            bool inBlock = r < blockRows;
+            for (size_t k = 0; k < width; ++k) {
+                packedRows[(tile * width + k) * GEMM_ROW_TILE + lane] = inBlock ? layout.columns[k][blockStart + r] : 0.0;
+            }
+            packedNorms[r] = inBlock ? layout.rowNorms[blockStart + r] : 0.0;
+        }
+
+        for (size_t tile = 0; tile < numTiles; ++tile) {
+            const double* tileValues = &packed[tile * width * GEMM_QUERY_TILE];
+            const double* tileNorms = &queryNorms[tile * GEMM_QUERY_TILE];
+            for (size_t rowTile = 0; rowTile < rowTiles; ++rowTile) {
+                size_t row = blockStart + rowTile * GEMM_ROW_TILE;
+                kernels.tile(&packedRows[rowTile * width * GEMM_ROW_TILE], width, tileValues, tileNorms, &packedNorms[rowTile * GEMM_ROW_TILE],
+                             distances, tileMin);
+                epilogue(tile, row, min(GEMM_ROW_TILE, numRows - row));
+            }
+        }
+    }
+
+    // Re-measure every candidate still near the minimum; candidates are in row order, so `<` keeps the lowest index
+    thread_local vector<double> queryRow;
+    queryRow.resize(width);
+    for (size_t q = 0; q < count; ++q) {
+        nearest[q] = excluded != nullptr ? excluded[q] : numRows;
+        nearestSquared[q] = numeric_limits<double>::infinity();
+        double bound = states[q].best + states[q].tolerance;
+        for (size_t k = 0; k < width; ++k) queryRow[k] = queryValue(q, k);
+        for (const auto& candidate : states[q].candidates) {
+            if (candidate.first > bound) continue;
+            double distance = directSquaredDistance(layout, queryRow.data(), candidate.second);
+            if (distance < nearestSquared[q]) {
+                nearestSquared[q] = distance;
+                nearest[q] = candidate.second;
+            }
+        }
+    }
+    countEvent(Counter::DistanceEvaluations, static_cast<uint64_t>(count) * (excluded != nullptr ? numRows - 1 : numRows));
+}
+
+// Nearest neighbor of each of the `count` held-out rows `queries` among all other rows of `data`: nearest[q] is
+// its row (the query itself if there is no other row) and nearestSquared[q] the squared distance.
+inline void findNearestGemm(const GemmLayout& layout, const FeatureMatrix& data, const size_t* queries, size_t count,
+                            size_t* nearest, double* nearestSquared) {
+    findNearestGemmQueries(layout, data.numRows, count, [&](size_t q, size_t k) { return layout.columns[k][queries[q]]; }, queries,
+                           nearest, nearestSquared);
+}
+
+// Nearest training row to each of `count` new rows given row-major in `points` (subset values in subset order)
+inline void findNearestGemmPoints(const GemmLayout& layout, size_t numRows, const double* points, size_t count,
+                                  size_t* nearest, double* nearestSquared) {
+    size_t width = layout.columns.size();
+    findNearestGemmQueries(layout, numRows, count, [&](size_t q, size_t k) { return points[q * width + k]; }, nullptr,
+                           nearest, nearestSquared);
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+using namespace std;
+
+// Built-in counters and timers for the hot paths, exported as a Chrome trace-event timeline
+// (chrome://tracing or ui.perfetto.dev) and as a per-step summary table.
+// Everything is off unless instrumentationEnabled is set before any work starts; every probe tests that flag
+// first, so a disabled build pays one predictable branch per probe. Probes sit at chunk, query, candidate and
+// step granularity, never inside the per-distance loops. Each thread counts and records into its own block,
+// so enabled probes never contend either; blocks are only summed at step boundaries and at export.
+
+inline bool instrumentationEnabled = false;
+
+enum class Counter {
+    DistanceEvaluations,  // Query-to-row distances computed or updated
+    NeighborQueries,      // Held-out rows whose nearest neighbor was looked up
+    CandidateEvaluations, // Candidate subsets scored by a search step
+    MemoHits,             // Candidate subsets answered by the subset memo
+    Allocations,          // Matrices, distance caches and scratch rows allocated or grown
+    NumCounters
+};
+
+const size_t NUM_COUNTERS = static_cast<size_t>(Counter::NumCounters);
+
+inline const char* counterName(Counter counter) {
+    static const char* names[] = {"distances", "nn_queries", "candidates", "memo_hits", "allocations"};
+    return names[static_cast<size_t>(counter)];
+}
+
+struct CounterTotals {
+    uint64_t values[NUM_COUNTERS] = {};
+
+    uint64_t operator[](Counter counter) const { return values[static_cast<size_t>(counter)]; }
+};
+
+// One complete ("ph":"X") trace event
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    int64_t startUs;
+    int64_t durationUs;
+    string args; // Preformatted JSON object body, may be empty
+};
+
+// Counters and events recorded by one thread. Only the owner writes; readers sum the atomics.
+struct ThreadRecord {
+    uint32_t threadId = 0;
+    atomic<uint64_t> counters[NUM_COUNTERS] = {};
+    vector<TraceEvent> events;
+};
+
+// Every thread's record plus the step summary rows, kept for the whole run
+class Profiler {
+public:
+    // One row of the per-step summary
+    struct StepRow {
+        string search;
+        int step;
+        double milliseconds;
+        CounterTotals counters;
+    };
+
+    ThreadRecord& threadRecord() {
+        thread_local ThreadRecord* record = nullptr;
+        if (record == nullptr) {
+            lock_guard<mutex> guard(lock);
+            records.push_back(make_unique<ThreadRecord>());
+            record = records.back().get();
+            record->threadId = static_cast<uint32_t>(records.size());
+        }
+        return *record;
+    }
+
+    // Sum over all threads; call between parallel regions for exact values
+    CounterTotals totals() {
+        CounterTotals sum;
+        lock_guard<mutex> guard(lock);
+        for (const auto& record : records) {
+            for (size_t c = 0; c < NUM_COUNTERS; ++c) sum.values[c] += record->counters[c].load(memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    void addStep(StepRow row) {
+        lock_guard<mutex> guard(lock);
+        steps.push_back(move(row));
+    }
+
+    int64_t nowUs() const {
+        return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - origin).count();
+    }
+
+    // Writes every recorded event as Chrome trace-event JSON, with the final counter totals as metadata
+    bool writeTrace(const string& path) {
+        ofstream file(path);
+        if (!file.is_open()) return false;
+        CounterTotals sum = totals();
+        lock_guard<mutex> guard(lock);
+        file << "{\"displayTimeUnit\": \"ms\", \"otherData\": {";
+        for (size_t c = 0; c < NUM_COUNTERS; ++c) {
+            file << (c ? ", " : "") << "\"" << counterName(static_cast<Counter>(c)) << "\": " << sum.values[c];
+        }
+        file << "},\n\"traceEvents\": [";
+        bool first = true;
+        for (const auto& record : records) {
+            for (const auto& event : record->events) {
+                file << (first ? "\n" : ",\n") << "{\"name\": \"" << event.name << "\", \"cat\": \"" << event.category
+                     << "\", \"ph\": \"X\", \"ts\": " << event.startUs << ", \"dur\": " << event.durationUs
+                     << ", \"pid\": 1, \"tid\": " << record->threadId;
+                if (!event.args.empty()) file << ", \"args\": {" << event.args << "}";
+                file << "}";
+                first = false;
+            }
+        }
+        file << "\n]}" << endl;
+        return static_cast<bool>(file);
+    }
+
+    // Prints one line per search step: wall time and what the step's counters added up to
+    void printStepSummary(ostream& out) {
+        lock_guard<mutex> guard(lock);
+        out << left << setw(15) << "Search" << right << setw(6) << "Step" << setw(11) << "Time(ms)";
+        for (size_t c = 0; c < NUM_COUNTERS; ++c) out << setw(14) << counterName(static_cast<Counter>(c));
+        out << endl;
+        for (const auto& row : steps) {
+            out << left << setw(15) << row.search << right << setw(6) << row.step << setw(11) << fixed << setprecision(2) << row.milliseconds;
+            for (size_t c = 0; c < NUM_COUNTERS; ++c) out << setw(14) << row.counters.values[c];
+            out << endl;
+        }
+        out << left;
+    }
+
+private:
+    mutex lock;
+    vector<unique_ptr<ThreadRecord>> records;
+    vector<StepRow> steps;
+    chrono::steady_clock::time_point origin = chrono::steady_clock::now();
+};
+
+inline Profiler& profiler() {
+    static Profiler instance;
+    return instance;
+}
+
+// Adds `amount` to `counter` for the calling thread
+inline void countEvent(Counter counter, uint64_t amount = 1) {
+    if (!instrumentationEnabled) return;
+    atomic<uint64_t>& value = profiler().threadRecord().counters[static_cast<size_t>(counter)];
+    value.store(value.load(memory_order_relaxed) + amount, memory_order_relaxed); // Owner-only, no lock prefix
+}
+
+// Records the lifetime of a scope as one trace event on the calling thread.
+// `name` and `category` must be string literals; `args` is only built by callers when enabled.
+class TraceScope {
+public:
+    TraceScope(const char* name, const char* category) : name(name), category(category) {
+        if (instrumentationEnabled) startUs = profiler().nowUs();
+    }
+
+    ~TraceScope() {
+        if (!instrumentationEnabled || startUs < 0) return;
+        profiler().threadRecord().events.push_back({name, category, startUs, profiler().nowUs() - startUs, move(args)});
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    string args;
+
+private:
+    const char* name;
+    const char* category;
+    int64_t startUs = -1;
+};
+
+// Times one search step and turns the counter deltas over it into a summary row and a trace event.
+// Steps start and finish on the thread driving the search while the pool is idle, so the deltas are exact.
+class StepProfiler {
+public:
+    StepProfiler(const char* search, int step) : scope("step", search), search(search), step(step) {
+        if (instrumentationEnabled) before = profiler().totals();
+    }
+
+    ~StepProfiler() {
+        if (!instrumentationEnabled) return;
+        CounterTotals after = profiler().totals();
+        Profiler::StepRow row{search, step, 0.0, {}};
+        for (size_t c = 0; c < NUM_COUNTERS; ++c) row.counters.values[c] = after.values[c] - before.values[c];
+        row.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        scope.args = "\"step\": " + to_string(step);
+        for (size_t c = 0; c < NUM_COUNTERS; ++c) {
+            scope.args += ", \"" + string(counterName(static_cast<Counter>(c))) + "\": " + to_string(row.counters.values[c]);
+        }
+        profiler().addStep(move(row));
+    }
+
+private:
+    TraceScope scope;
+    const char* search;
+    int step;
+    CounterTotals before;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+};
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+
+#include "threadPool.h"
+#include "instrumentation.h"
+
+using namespace std;
+
+// k-nearest-neighbor voting on top of the distance rows the 1-NN code already computes.
+// A held-out row's k nearest rows are collected in a bounded max-heap while its distance row is scanned,
+// so the cost stays one pass over the row whatever k is. With k = 1 every caller keeps its original
+// argmin path, which is why 1-NN results are unchanged by anything in this file.
+
+// Added to a neighbor's distance before it is inverted, so exact duplicates get a large but finite weight
+const double VOTE_DISTANCE_EPSILON = 1e-9;
+
+enum class VoteRule {
+    Majority, // Every one of the k neighbors counts once
+    Weighted  // Each neighbor counts 1 / distance
+};
+
+inline bool parseVoteRule(const string& name, VoteRule& rule) {
+    if (name == "majority") rule = VoteRule::Majority;
+    else if (name == "weighted") rule = VoteRule::Weighted;
+    else return false;
+    return true;
+}
+
+inline const char* voteRuleName(VoteRule rule) {
+    return rule == VoteRule::Weighted ? "weighted" : "majority";
+}
+
+// How held-out rows are classified from their neighbors
+struct NeighborVote {
+    int k = 1;
+    VoteRule rule = VoteRule::Majority;
+
+    bool isOneNearest() const { return k <= 1; } // Weighting a single neighbor changes nothing
+};
+
+// One candidate neighbor: squared distance and row index. Pairs order by distance and then by index,
+// so among equally distant rows the lowest index counts as nearer, as argmin picks it.
+template <typename D>
+using Neighbor = pair<D, size_t>;
+
+// The `capacity` nearest rows offered so far, kept as a max-heap so the farthest one is replaced in O(log k)
+template <typename D>
+class NeighborHeap {
+public:
+    void reset(size_t newCapacity) {
+        capacity = newCapacity;
+        entries.clear();
+    }
+
+    bool full() const { return entries.size() >= capacity; }
+    D farthest() const { return entries.front().first; }
+
+    void offer(D distance, size_t row) {
+        Neighbor<D> candidate(distance, row);
+        if (entries.size() < capacity) {
+            entries.push_back(candidate);
+            push_heap(entries.begin(), entries.end());
+        } else if (candidate < entries.front()) {
+            pop_heap(entries.begin(), entries.end());
+            entries.back() = candidate;
+            push_heap(entries.begin(), entries.end());
+        }
+    }
+
+    // Nearest first; the heap must be reset before it is offered rows again
+    const vector<Neighbor<D>>& sorted() {
+        sort_heap(entries.begin(), entries.end());
+        return entries;
+    }
+
+private:
+    size_t capacity = 1;
+    vector<Neighbor<D>> entries;
+};
+
+// Per-thread heap, reused across held-out rows so the leave-one-out loops never allocate
+template <typename D>
+NeighborHeap<D>& neighborHeap(size_t capacity) {
+    thread_local NeighborHeap<D> heap;
+    heap.reset(capacity);
+    return heap;
+}
+
+// The `k` nearest rows to held-out row `exclude` in its distance row, nearest first.
+// Rows are offered in index order, so once the heap is full a row that only ties the farthest can be skipped.
+template <typename D>
+const vector<Neighbor<D>>& nearestNeighbors(const D* distances, size_t numRows, size_t exclude, size_t k) {
+    NeighborHeap<D>& heap = neighborHeap<D>(k);
+    for (size_t j = 0; j < numRows; ++j) {
+        if (j == exclude || (heap.full() && distances[j] >= heap.farthest())) continue;
+        heap.offer(distances[j], j);
+    }
+    return heap.sorted();
+}
+
+// Running vote over neighbors added nearest first. Classes are kept in the order their first neighbor
+// arrived, so a tie goes to the class with the nearest member, which with one neighbor is plain 1-NN.
+class VoteTally {
+public:
+    explicit VoteTally(VoteRule rule) : rule(rule) {}
+
+    template <typename D>
+    void add(const Neighbor<D>& neighbor, int label) {
+        double weight = rule == VoteRule::Weighted ? 1.0 / (sqrt(static_cast<double>(neighbor.first)) + VOTE_DISTANCE_EPSILON) : 1.0;
+        for (auto& tally : tallies) {
+            if (tally.first == label) {
+                tally.second += weight;
+                return;
+            }
+        }
+        tallies.emplace_back(label, weight);
+    }
+
+    // Winning label so far, -1 before any neighbor was added
+    int winner() const {
+        int label = -1;
+        double best = 0.0;
+        for (const auto& tally : tallies) {
+            if (tally.second > best) {
+                best = tally.second;
+                label = tally.first;
+            }
+        }
+        return label;
+    }
+
+private:
+    VoteRule rule;
+    vector<pair<int, double>> tallies; // Label and accumulated weight, in order of first appearance
+};
+
+// Label the first `k` of `neighbors` (nearest first) vote for
+template <typename D>
+int voteLabel(const vector<Neighbor<D>>& neighbors, size_t k, const vector<int>& labels, VoteRule rule) {
+    VoteTally tally(rule);
+    for (size_t n = 0; n < min(k, neighbors.size()); ++n) tally.add(neighbors[n], labels[neighbors[n].second]);
+    return tally.winner();
+}
+
+// k-NN prediction for held-out row i from its distance row
+template <typename D>
+int predictByVote(const D* distances, size_t numRows, size_t i, const vector<int>& labels, const NeighborVote& vote) {
+    const auto& neighbors = nearestNeighbors(distances, numRows, i, static_cast<size_t>(vote.k));
+    return voteLabel(neighbors, neighbors.size(), labels, vote.rule);
+}
+
+// k-NN prediction from a distance row whose values carry rounding noise (subtracted sums). The k nearest by
+// the noisy values fix a cut-off; every row within `tolerance` of it is re-measured with exactDistance(j)
+// and the vote is taken over the k nearest by exact distance, as the 1-NN removal path does for its minimum.
+template <typename D, typename ExactDistance>
+int predictByVoteRechecked(const D* distances, size_t numRows, size_t i, const vector<int>& labels, const NeighborVote& vote,
+                           D tolerance, ExactDistance exactDistance) {
+    const auto& approximate = nearestNeighbors(distances, numRows, i, static_cast<size_t>(vote.k));
+    if (approximate.empty()) return -1;
+    D cutoff = approximate.back().first + tolerance; // Read before the per-thread heap is reset below
+
+    NeighborHeap<D>& heap = neighborHeap<D>(static_cast<size_t>(vote.k));
+    for (size_t j = 0; j < numRows; ++j) {
+        if (j == i || distances[j] > cutoff) continue;
+        heap.offer(exactDistance(j), j);
+    }
+    const auto& neighbors = heap.sorted();
+    return voteLabel(neighbors, neighbors.size(), labels, vote.rule);
+}
+
+// Leave-one-out accuracy (in percent) for every k from 1 to maxK from one top-maxK list per held-out row:
+// the votes for k and k + 1 differ by one neighbor, so the whole sweep costs about as much as the largest k.
+// fillRow(i) returns held-out row i's squared distance to every row, in a buffer owned by the calling thread.
+template <typename D, typename FillRow>
+vector<double> leaveOneOutAccuracyByK(size_t numRows, const vector<int>& labels, int maxK, VoteRule rule, ThreadPool& pool, FillRow fillRow) {
+    size_t numChunks = (numRows + LOO_ROWS_PER_TASK - 1) / LOO_ROWS_PER_TASK;
+    vector<vector<size_t>> chunkCorrect(numChunks, vector<size_t>(maxK, 0)); // Correct predictions per task and k
+
+    pool.parallelForRange(numRows, LOO_ROWS_PER_TASK, [&](size_t begin, size_t end) {
+        vector<size_t>& correct = chunkCorrect[begin / LOO_ROWS_PER_TASK];
+        for (size_t i = begin; i < end; ++i) {
+            const D* distances = fillRow(i);
+            const auto& neighbors = nearestNeighbors(distances, numRows, i, static_cast<size_t>(maxK));
+
+            VoteTally tally(rule);
+            int predictedLabel = -1;
+            for (int k = 1; k <= maxK; ++k) {
+                if (static_cast<size_t>(k) <= neighbors.size()) {
+                    tally.add(neighbors[k - 1], labels[neighbors[k - 1].second]);
+                    predictedLabel = tally.winner();
+                }
+                if (predictedLabel == labels[i]) ++correct[k - 1]; // Fewer rows than k: every row votes
+            }
+        }
+    });
+    countEvent(Counter::NeighborQueries, numRows);
+    countEvent(Counter::DistanceEvaluations, static_cast<uint64_t>(numRows) * numRows);
+
+    vector<double> accuracies(maxK, 0.0);
+    for (int k = 0; k < maxK; ++k) {
+        size_t correctPredictions = 0;
+        for (const auto& counts : chunkCorrect) correctPredictions += counts[k];
+        accuracies[k] = numRows == 0 ? 0.0 : static_cast<double>(correctPredictions) / numRows * 100.0;
+    }
+    return accuracies;
+}
@@ -0,0 +1,169 @@
+// Micro-benchmark for the squared-distance kernels in distanceKernels.h.
+// For every kernel family the CPU supports, measures how many query-to-row distances per second
+// a nearest-neighbor scan achieves (accumulate w columns, then argmin) for subset widths 1 to 64, and
+// the same for the blocked matrix-multiply search in gemmDistances.h; GEMM_MIN_WIDTH comes from where the
+// last column overtakes the others. Before timing anything it checks that the matrix-multiply search picks the
+// same training row as the column scan for new rows, inside the training range and far outside it, and exits
+// with status 1 if it ever does not.
+//
+// Build: g++ -O2 -std=c++17 -pthread kernelBenchmark.cpp -o kernelBenchmark
+// Usage: ./kernelBenchmark [rows]
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <cmath>
+
+#include "featureMatrix.h"
+#include "distanceKernels.h"
+#include "gemmDistances.h"
+
+using namespace std;
+using std::chrono::high_resolution_clock;
+using std::chrono::duration;
+
+const size_t MAX_WIDTH = 64;
+const double MIN_SECONDS = 0.2; // Each measurement repeats until it has run at least this long
+
+// Times full nearest-neighbor scans over the first `width` columns and returns distances per second
+double measureThroughput(const DistanceKernels& kernels, const FeatureMatrix& data, size_t width) {
+    vector<double> distances(data.numRows);
+    size_t scans = 0;
+    size_t checksum = 0; // Keeps the compiler from discarding the work
+    auto start = high_resolution_clock::now();
+    double elapsed = 0.0;
+
+    while (elapsed < MIN_SECONDS) {
+        for (size_t q = 0; q < 64; ++q, ++scans) {
+            size_t testIndex = (scans * 7919) % data.numRows;
+            fill(distances.begin(), distances.end(), 0.0);
+            for (size_t f = 0; f < width; ++f) {
+                const double* column = data.column(f);
+                kernels.addSquaredColumn(distances.data(), column, column[testIndex], distances.data(), data.numRows);
+            }
+            excludeRow(distances.data(), testIndex);
+            checksum += kernels.argmin(distances.data(), data.numRows);
+        }
+        elapsed = duration<double>(high_resolution_clock::now() - start).count();
+    }
+
+    volatile size_t sink = checksum;
+    (void)sink;
+    return static_cast<double>(scans) * data.numRows / elapsed;
+}
+
+// Times blocked matrix-multiply searches over the first `width` columns, 64 held-out rows per block
+double measureGemmThroughput(const FeatureMatrix& data, size_t width) {
+    vector<int> features;
+    for (size_t f = 1; f <= width; ++f) features.push_back(static_cast<int>(f));
+    GemmLayout layout = buildGemmLayout(data, features);
+    size_t queries[64], nearest[64];
+    double nearestSquared[64];
+    size_t scans = 0;
+    size_t checksum = 0;
+    auto start = high_resolution_clock::now();
+    double elapsed = 0.0;
+
+    while (elapsed < MIN_SECONDS) {
+        for (size_t q = 0; q < 64; ++q, ++scans) queries[q] = (scans * 7919) % data.numRows;
+        findNearestGemm(layout, data, queries, 64, nearest, nearestSquared);
+        checksum += nearest[0];
+        elapsed = duration<double>(high_resolution_clock::now() - start).count();
+    }
+
+    volatile size_t sink = checksum;
+    (void)sink;
+    return static_cast<double>(scans) * data.numRows / elapsed;
+}
+
+// Nearest row to every new row of `points` (row-major, `width` values each) by the selected column scan: columns
+// summed in order, lowest index on ties. This is the reference findNearestGemmPoints must reproduce.
+vector<size_t> nearestByScan(const FeatureMatrix& data, size_t width, const vector<double>& points) {
+    const DistanceKernels& kernels = distanceKernels();
+    vector<double> distances(data.numRows);
+    vector<size_t> nearest;
+    for (size_t q = 0; q < points.size() / width; ++q) {
+        fill(distances.begin(), distances.end(), 0.0);
+        for (size_t f = 0; f < width; ++f) {
+            kernels.addSquaredColumn(distances.data(), data.column(f), points[q * width + f], distances.data(), data.numRows);
+        }
+        nearest.push_back(kernels.argmin(distances.data(), data.numRows));
+    }
+    return nearest;
+}
+
+// Counts the new rows for which the matrix-multiply search and the column scan pick different training rows.
+// The training rows are tie-heavy (a first feature of 0, 0.5 or 1 and the rest within 1e-3), so the identity's
+// rounding decides between near neighbors. Half the new rows lie in [0, 1] like the training data; in the other
+// half the first feature is between 1e3 and 1e8, as rows normalized with a training set's ranges can be.
+size_t checkGemmAgreement(mt19937& generator) {
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+    uniform_real_distribution<double> exponent(3.0, 8.0);
+    const size_t numRows = 2000, numQueries = 512;
+    FeatureMatrix data = makeFeatureMatrix(numRows, MAX_WIDTH);
+    for (size_t row = 0; row < numRows; ++row) {
+        data.at(row, 0) = floor(uniform(generator) * 3.0) / 2.0;
+        for (size_t f = 1; f < MAX_WIDTH; ++f) data.at(row, f) = uniform(generator) * 1e-3;
+    }
+
+    size_t mismatches = 0;
+    for (size_t width : {4, 8, 16, 64}) {
+        vector<int> features;
+        for (size_t f = 1; f <= width; ++f) features.push_back(static_cast<int>(f));
+        GemmLayout layout = buildGemmLayout(data, features);
+        for (bool outOfRange : {false, true}) {
+            vector<double> points(numQueries * width);
+            for (size_t q = 0; q < numQueries; ++q) {
+                for (size_t f = 0; f < width; ++f) points[q * width + f] = uniform(generator);
+                if (outOfRange) points[q * width] = pow(10.0, exponent(generator));
+            }
+            vector<size_t> expected = nearestByScan(data, width, points);
+            vector<size_t> nearest(numQueries);
+            vector<double> nearestSquared(numQueries);
+            for (size_t start = 0; start < numQueries; start += 64) {
+                findNearestGemmPoints(layout, data.numRows, &points[start * width], 64, &nearest[start], &nearestSquared[start]);
+            }
+            for (size_t q = 0; q < numQueries; ++q) mismatches += nearest[q] != expected[q];
+        }
+    }
+    return mismatches;
+}
+
+int main(int argc, char* argv[]) {
+    size_t rows = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4096;
+
+    // Random normalized data, the same shape the search loops see after normalizeFeatures
+    FeatureMatrix data = makeFeatureMatrix(rows, MAX_WIDTH);
+    mt19937 generator(42);
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+    for (size_t f = 0; f < MAX_WIDTH; ++f) {
+        for (size_t row = 0; row < rows; ++row) data.at(row, f) = uniform(generator);
+    }
+
+    size_t mismatches = checkGemmAgreement(generator);
+    if (mismatches > 0) {
+        cerr << "Error: the matrix-multiply search and the column scan disagree on " << mismatches << " new rows" << endl;
+        return 1;
+    }
+
+    vector<DistanceKernels> kernels = availableDistanceKernels();
+    vector<size_t> widths = {1, 2, 4, 8, 12, 16, 24, 32, 48, 64};
+
+    cout << "Rows: " << rows << ", selected kernel: " << distanceKernels().name << endl;
+    cout << "Distances/sec (millions)" << endl;
+    cout << setw(8) << "width";
+    for (const auto& kernel : kernels) cout << setw(12) << kernel.name;
+    cout << setw(12) << "gemm" << endl;
+
+    for (size_t width : widths) {
+        cout << setw(8) << width;
+        for (const auto& kernel : kernels) {
+            cout << setw(12) << fixed << setprecision(1) << measureThroughput(kernel, data, width) / 1e6;
+        }
+        cout << setw(12) << fixed << setprecision(1) << measureGemmThroughput(data, width) / 1e6 << endl;
+    }
+    return 0;
+}
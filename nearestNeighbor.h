@@ -0,0 +1,317 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <limits>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+#include "featureMatrix.h"
+#include "distanceKernels.h"
+#include "spatialIndex.h"
+#include "gemmDistances.h"
+
+using namespace std;
+
+// How leave-one-out finds each held-out row's nearest neighbor
+enum class NeighborMethod {
+    Auto,         // Time the candidates on a few rows and keep the fastest
+    BruteForce,   // Column-at-a-time SIMD scan over every row
+    EarlyAbandon, // Row-at-a-time scan that stops once a row cannot beat the best so far
+    KdTree,       // KD-tree over the subset; pays off for narrow subsets
+    VpTree,       // Vantage-point tree over the subset; degrades more slowly as the subset widens
+    Gemm          // Blocks of held-out rows against all rows as a tiled matrix multiply; pays off for wide subsets
+};
+
+// Parses a --nn value ("auto", "brute", "early", "kd", "vp" or "gemm"); returns false if it is not recognized
+inline bool parseNeighborMethod(const string& name, NeighborMethod& method) {
+    if (name == "auto") method = NeighborMethod::Auto;
+    else if (name == "brute") method = NeighborMethod::BruteForce;
+    else if (name == "early") method = NeighborMethod::EarlyAbandon;
+    else if (name == "kd") method = NeighborMethod::KdTree;
+    else if (name == "vp") method = NeighborMethod::VpTree;
+    else if (name == "gemm") method = NeighborMethod::Gemm;
+    else return false;
+    return true;
+}
+
+// Narrower subsets always use brute force: there are too few features to abandon early
+const size_t EARLY_ABANDON_MIN_WIDTH = 8;
+
+// Nearby rows in the highest-variance feature that are scored first to seed the best distance
+const size_t EARLY_ABANDON_SEEDS = 2;
+
+// A partial sum must exceed the best distance by this much before a row is abandoned, so rounding in the
+// reordered sum can never discard the true nearest neighbor (features are normalized to [0, 1])
+const double EARLY_ABANDON_TOLERANCE = 1e-9;
+
+// Held-out rows timed with each method when NeighborMethod::Auto picks one
+const size_t CALIBRATION_QUERIES = 16;
+
+// How much of the distance work the early-abandon scan actually did
+struct PruningCounters {
+    uint64_t dimensionsComputed = 0; // Per-feature squared differences that were accumulated
+    uint64_t dimensionsTotal = 0;    // Squared differences a full scan would have accumulated
+
+    void add(const PruningCounters& other) {
+        dimensionsComputed += other.dimensionsComputed;
+        dimensionsTotal += other.dimensionsTotal;
+    }
+
+    double skippedFraction() const {
+        return dimensionsTotal == 0 ? 0.0 : 1.0 - static_cast<double>(dimensionsComputed) / dimensionsTotal;
+    }
+};
+
+// Nearest-neighbor search prepared for one feature subset
+struct NeighborSearch {
+    const FeatureMatrix* data = nullptr;
+    vector<int> features;          // 1-based subset, in the order distances are summed
+    NeighborMethod method = NeighborMethod::BruteForce;
+
+    // Early-abandon layout: row-major copy of the subset with columns ordered by decreasing variance,
+    // so the big contributors come first and a partial sum crosses the best distance as early as possible
+    vector<double> rows;           // numRows x width values, one row after another
+    vector<size_t> packedPosition; // packedPosition[k] = where features[k] sits inside a packed row
+    vector<size_t> seedOrder;      // Row indices sorted by the highest-variance feature
+    vector<size_t> seedRank;       // Position of each row within seedOrder
+
+    // Spatial indexes and the matrix-multiply layout, built only for the method that uses them
+    KdTree kdTree;
+    VpTree vpTree;
+    GemmLayout gemm;
+
+    size_t width() const { return features.size(); }
+};
+
+// Fills `distances` with the squared distance from `testIndex` to every row over `features`, one column at a time
+inline void accumulateSubsetDistances(const FeatureMatrix& data, size_t testIndex, const vector<int>& features, double* distances) {
+    const DistanceKernels& kernels = distanceKernels();
+    fill(distances, distances + data.numRows, 0.0);
+    for (int feature : features) {
+        const double* column = data.column(feature - 1); // Convert 1-based index to 0-based
+        kernels.addSquaredColumn(distances, column, column[testIndex], distances, data.numRows);
+    }
+}
+
+// Brute-force nearest neighbor: the first row with the smallest squared distance
+inline size_t findNearestBruteForce(const NeighborSearch& search, size_t testIndex, double& nearestSquared) {
+    const FeatureMatrix& data = *search.data;
+    double* distances = scratchRow(data.numRows);
+    accumulateSubsetDistances(data, testIndex, search.features, distances);
+    excludeRow(distances, testIndex); // Leave out the test instance
+    size_t nearest = distanceKernels().argmin(distances, data.numRows);
+    countEvent(Counter::DistanceEvaluations, data.numRows - 1);
+    nearestSquared = distances[nearest];
+    return nearest;
+}
+
+// Packs the subset row-major in variance order and sorts rows by the leading column for seeding
+inline void buildEarlyAbandonLayout(NeighborSearch& search) {
+    const FeatureMatrix& data = *search.data;
+    size_t width = search.width();
+
+    // Order the columns by variance, largest first
+    vector<pair<double, size_t>> byVariance;
+    for (size_t k = 0; k < width; ++k) {
+        const double* column = data.column(search.features[k] - 1);
+        double mean = 0.0, squares = 0.0;
+        for (size_t row = 0; row < data.numRows; ++row) mean += column[row];
+        mean /= max<size_t>(data.numRows, 1);
+        for (size_t row = 0; row < data.numRows; ++row) squares += (column[row] - mean) * (column[row] - mean);
+        byVariance.push_back({-squares, k});
+    }
+    stable_sort(byVariance.begin(), byVariance.end());
+
+    search.rows.resize(data.numRows * width);
+    search.packedPosition.resize(width);
+    for (size_t p = 0; p < width; ++p) {
+        size_t k = byVariance[p].second;
+        search.packedPosition[k] = p;
+        const double* column = data.column(search.features[k] - 1);
+        for (size_t row = 0; row < data.numRows; ++row) {
+            search.rows[row * width + p] = column[row];
+        }
+    }
+
+    // Sorting by the leading column lets a query find rows that are already close in that feature
+    search.seedOrder.resize(data.numRows);
+    for (size_t row = 0; row < data.numRows; ++row) search.seedOrder[row] = row;
+    stable_sort(search.seedOrder.begin(), search.seedOrder.end(), [&](size_t a, size_t b) {
+        return search.rows[a * width] < search.rows[b * width];
+    });
+    search.seedRank.resize(data.numRows);
+    for (size_t rank = 0; rank < data.numRows; ++rank) search.seedRank[search.seedOrder[rank]] = rank;
+}
+
+// Early-abandon nearest neighbor.
+// Partial sums in variance order are compared against the best distance every four features and the row
+// is dropped once it is provably farther. A row that survives is re-summed in subset order, the same way
+// the brute-force scan sums it, so both methods always pick the same neighbor (lowest index on ties).
+inline size_t findNearestEarlyAbandon(const NeighborSearch& search, size_t testIndex, double& nearestSquared, PruningCounters& counters) {
+    size_t width = search.width();
+    size_t numRows = search.data->numRows;
+    const double* x = &search.rows[testIndex * width];
+    size_t best = testIndex;
+    double bestDistance = numeric_limits<double>::infinity();
+    uint64_t computed = 0;
+
+    auto consider = [&](size_t j) {
+        const double* y = &search.rows[j * width];
+        double bound = bestDistance + EARLY_ABANDON_TOLERANCE;
+        double partial = 0.0;
+        size_t f = 0;
+        for (; f + 4 <= width; f += 4) {
+            double d0 = x[f] - y[f], d1 = x[f + 1] - y[f + 1], d2 = x[f + 2] - y[f + 2], d3 = x[f + 3] - y[f + 3];
+            partial += (d0 * d0 + d1 * d1) + (d2 * d2 + d3 * d3);
+            if (partial > bound) { // Cannot beat (or tie) the best neighbor any more
+                computed += f + 4;
+                return;
+            }
+        }
+        for (; f < width; ++f) {
+            double diff = x[f] - y[f];
+            partial += diff * diff;
+        }
+        computed += width;
+        if (partial > bound) return;
+
+        // Exact distance in subset order
+        double distance = 0.0;
+        for (size_t k = 0; k < width; ++k) {
+            double diff = x[search.packedPosition[k]] - y[search.packedPosition[k]];
+            distance += diff * diff;
+        }
+        computed += width;
+        if (distance < bestDistance || (distance == bestDistance && j < best)) {
+            bestDistance = distance;
+            best = j;
+        }
+    };
+
+    // Seed with the rows adjacent in the highest-variance feature so most later scans abandon early
+    size_t rank = search.seedRank[testIndex];
+    for (size_t step = 1; step <= EARLY_ABANDON_SEEDS; ++step) {
+        if (rank >= step) consider(search.seedOrder[rank - step]);
+        if (rank + step < numRows) consider(search.seedOrder[rank + step]);
+    }
+
+    for (size_t j = 0; j < numRows; ++j) {
+        if (j != testIndex) consider(j);
+    }
+
+    countEvent(Counter::DistanceEvaluations, numRows - 1); // Every other row gets at least a partial sum
+    counters.dimensionsComputed += computed;
+    counters.dimensionsTotal += static_cast<uint64_t>(numRows - 1) * width;
+    nearestSquared = bestDistance;
+    return best;
+}
+
+// Nearest neighbor of row `testIndex` among all other rows; returns testIndex if there is no other row
+inline size_t findNearest(const NeighborSearch& search, size_t testIndex, double& nearestSquared, PruningCounters& counters) {
+    countEvent(Counter::NeighborQueries);
+    switch (search.method) {
+    case NeighborMethod::EarlyAbandon: return findNearestEarlyAbandon(search, testIndex, nearestSquared, counters);
+    case NeighborMethod::KdTree: return findNearestKdTree(search.kdTree, testIndex, nearestSquared);
+    case NeighborMethod::VpTree: return findNearestVpTree(search.vpTree, testIndex, nearestSquared);
+    case NeighborMethod::Gemm: {
+        size_t nearest;
+        findNearestGemm(search.gemm, *search.data, &testIndex, 1, &nearest, &nearestSquared);
+        return nearest;
+    }
+    default: break;
+    }
+    return findNearestBruteForce(search, testIndex, nearestSquared);
+}
+
+// findNearest for each of the `count` rows in `queries`. The matrix-multiply method needs whole blocks of
+// held-out rows to fill its register tiles, so leave-one-out loops hand over their chunk of rows at once.
+inline void findNearestBatch(const NeighborSearch& search, const size_t* queries, size_t count, size_t* nearest, double* nearestSquared,
+                             PruningCounters& counters) {
+    if (search.method != NeighborMethod::Gemm) {
+        for (size_t q = 0; q < count; ++q) nearest[q] = findNearest(search, queries[q], nearestSquared[q], counters);
+        return;
+    }
+    countEvent(Counter::NeighborQueries, count);
+    findNearestGemm(search.gemm, *search.data, queries, count, nearest, nearestSquared);
+}
+
+// Builds whatever `method` needs on top of the plain subset (brute force needs nothing)
+inline void buildNeighborStructures(NeighborSearch& search, NeighborMethod method) {
+    if (method == NeighborMethod::EarlyAbandon) buildEarlyAbandonLayout(search);
+    else if (method == NeighborMethod::KdTree) search.kdTree = buildKdTree(*search.data, search.features);
+    else if (method == NeighborMethod::VpTree) search.vpTree = buildVpTree(*search.data, search.features);
+    else if (method == NeighborMethod::Gemm) search.gemm = buildGemmLayout(*search.data, search.features);
+}
+
+// Prepares nearest-neighbor queries over the 1-based `features` of `data`.
+// NeighborMethod::Auto builds each candidate, times it on CALIBRATION_QUERIES rows and keeps the one with the
+// lowest projected cost (build time plus one query per row). Which one wins depends on the CPU's SIMD width,
+// the number of rows and how clustered the data is: trees stop pruning once the subset is wide relative to
+// the data's intrinsic dimension, and then the SIMD scan takes over. From GEMM_MIN_WIDTH features on, the
+// matrix-multiply method competes too; it is timed on the whole sample as one block, the way it is run.
+inline NeighborSearch prepareNeighborSearch(const FeatureMatrix& data, const vector<int>& features, NeighborMethod method) {
+    TraceScope trace("prepareNeighborSearch", "loo");
+    NeighborSearch search;
+    search.data = &data;
+    search.features = features;
+    search.method = method;
+
+    if (method == NeighborMethod::BruteForce || features.empty()) {
+        search.method = NeighborMethod::BruteForce;
+        return search;
+    }
+    if (method != NeighborMethod::Auto) {
+        buildNeighborStructures(search, method);
+        return search;
+    }
+
+    vector<NeighborMethod> candidates = {NeighborMethod::BruteForce};
+    if (features.size() >= EARLY_ABANDON_MIN_WIDTH) candidates.push_back(NeighborMethod::EarlyAbandon);
+    candidates.push_back(NeighborMethod::KdTree);
+    candidates.push_back(NeighborMethod::VpTree);
+    if (features.size() >= GEMM_MIN_WIDTH) candidates.push_back(NeighborMethod::Gemm);
+    search.method = NeighborMethod::BruteForce;
+    if (data.numRows < 2 * CALIBRATION_QUERIES) return search;
+
+    // Time every candidate on the same spread-out sample of held-out rows
+    using std::chrono::steady_clock;
+    using std::chrono::duration;
+    PruningCounters ignored;
+    size_t spacing = data.numRows / CALIBRATION_QUERIES;
+    size_t sample[CALIBRATION_QUERIES], sampleNearest[CALIBRATION_QUERIES];
+    double sampleSquared[CALIBRATION_QUERIES];
+    for (size_t q = 0; q < CALIBRATION_QUERIES; ++q) sample[q] = q * spacing;
+    double bestCost = numeric_limits<double>::infinity();
+    NeighborMethod best = NeighborMethod::BruteForce;
+
+    for (NeighborMethod candidate : candidates) {
+        auto buildStart = steady_clock::now();
+        buildNeighborStructures(search, candidate);
+        auto queryStart = steady_clock::now();
+        search.method = candidate;
+        findNearestBatch(search, sample, CALIBRATION_QUERIES, sampleNearest, sampleSquared, ignored);
+        auto queryEnd = steady_clock::now();
+
+        double perQuery = duration<double>(queryEnd - queryStart).count() / CALIBRATION_QUERIES;
+        double cost = duration<double>(queryStart - buildStart).count() + perQuery * data.numRows;
+        if (cost < bestCost) {
+            bestCost = cost;
+            best = candidate;
+        }
+    }
+
+    // Keep only the winner's structures
+    search.method = best;
+    if (best != NeighborMethod::EarlyAbandon) {
+        search.rows = {};
+        search.packedPosition = {};
+        search.seedOrder = {};
+        search.seedRank = {};
+    }
+    if (best != NeighborMethod::KdTree) search.kdTree = {};
+    if (best != NeighborMethod::VpTree) search.vpTree = {};
+    if (best != NeighborMethod::Gemm) search.gemm = {};
+    return search;
+}
@@ -8,199 +8,118 @@
 #include <set>
 #include <limits>
 #include <chrono> // For timing
+#include <cstring> // For strcmp
+#include <thread>  // For hardware_concurrency
+
+#include "featureMatrix.h" // Columnar dataset storage and normalization
+#include "datasetParser.h" // Memory-mapped dataset parsing
+#include "datasetCache.h"  // Binary cache of the normalized dataset
+#include "threadPool.h"    // Work-stealing pool for the leave-one-out loop
+#include "nearestNeighbor.h" // Brute-force and early-abandon nearest-neighbor scans
 
 using namespace std;
 using std::chrono::high_resolution_clock;
 using std::chrono::duration_cast;
 using std::chrono::milliseconds;
-
-// Represents a single data instance with its features and label
-struct Instance {
-    vector<double> features; // The list of feature values for the instance
-    int label;               // The class label (1 or 2)
-};
-
-// Reads the dataset file and stores the rows as instances of features and labels.
-// The first column is treated as the label, and the rest are feature values.
-void parseDataset(const string& filename, vector<Instance>& instances) {
-    ifstream file(filename);
-    if (!file.is_open()) {
-        cerr << "Error: Unable to open file " << filename << endl;
-        exit(1);
-    }
-
-    string line;
-    while (getline(file, line)) {
-        stringstream ss(line);
-        double value;
-        vector<double> features;
-        int label;
-
-        // Extract the label (first column)
-        ss >> label;
-
-        // Extract the feature values (remaining columns)
-        while (ss >> value) {
-            features.push_back(value);
-        }
-
-        // Remove any extraneous initial values (e.g., 0) from the feature list
-        if (!features.empty() && features[0] == 0) {
-            features.erase(features.begin());
-        }
-
-        // Add the instance to the dataset
-        instances.push_back({features, label});
-    }
-
-    file.close();
-
-    // Print the first 5 parsed instances for debugging and verification
-    /*cout << "First 5 parsed instances:" << endl;
-    for (size_t i = 0; i < min(instances.size(), size_t(5)); ++i) {
-        cout << "Label: " << instances[i].label << " Features: ";
-        for (double feature : instances[i].features) {
-            cout << feature << " ";
-        }
-        cout << endl;
-    }
-    */
-}
-
-// Normalizes the feature values for all instances to the range [0, 1].
-// This is done by computing the minimum and maximum for each feature across all instances
-// and then scaling the values using the formula: (value - min) / (max - min).
-void normalizeFeatures(vector<Instance>& instances) {
-    size_t numFeatures = instances[0].features.size();
-    vector<double> minValues(numFeatures, numeric_limits<double>::max());
-    vector<double> maxValues(numFeatures, numeric_limits<double>::lowest());
-
-    // Compute the minimum and maximum for each feature
-    for (const auto& instance : instances) {
-        for (size_t i = 0; i < numFeatures; ++i) {
-            minValues[i] = min(minValues[i], instance.features[i]);
-            maxValues[i] = max(maxValues[i], instance.features[i]);
-        }
-    }
-
-    // Normalize each feature value for all instances
-    for (auto& instance : instances) {
-        for (size_t i = 0; i < numFeatures; ++i) {
-            if (maxValues[i] != minValues[i]) { // Avoid division by zero
-                instance.features[i] = (instance.features[i] - minValues[i]) / (maxValues[i] - minValues[i]);
-            } else {
-                instance.features[i] = 0.0; // If all values are the same, set the feature to 0
-            }
-        }
-    }
-
-    // Print the first 5 normalized instances for debugging
-    /*
-    cout << "First 5 normalized instances:" << endl;
-    for (size_t i = 0; i < min(instances.size(), size_t(5)); ++i) {
-        cout << "Label: " << instances[i].label << " Features: ";
-        for (double feature : instances[i].features) {
-            cout << feature << " ";
-        }
-        cout << endl;
-    }
-    */
-}
-
-// Filters the dataset to only include selected features based on their indices.
-// Indices in `selectedFeatures` are 1-based and are adjusted to 0-based for internal processing.
-vector<Instance> filterFeatures(const vector<Instance>& data, const set<int>& selectedFeatures) {
-    vector<Instance> filteredData;
-
-    for (const auto& instance : data) {
-        vector<double> filteredFeatures;
-        for (int feature : selectedFeatures) {
-            filteredFeatures.push_back(instance.features[feature - 1]); // Adjust 1-based index to 0-based
-        }
-        filteredData.push_back({filteredFeatures, instance.label});
-    }
-
-    // Print the first 5 filtered instances for debugging
-    /**
-    cout << "First 5 filtered instances:" << endl;
-    for (size_t i = 0; i < min(filteredData.size(), size_t(5)); ++i) {
-        cout << "Label: " << filteredData[i].label << " Features: ";
-        for (double feature : filteredData[i].features) {
-            cout << feature << " ";
-        }
-        cout << endl;
+using std::chrono::microseconds;
+
+// Predicts the label of the instance at `testIndex` from its nearest neighbor `nearest`, as found by
+// findNearestBatch. Every other instance in the prepared search acts as the training set; the test row is
+// skipped in place instead of being copied out, and the distance to the chosen neighbor is stored in
+// `nearestDistance`. The search works on squared distances, so the root is only taken for the winner.
+int predictLabel(const NeighborSearch& search, size_t testIndex, size_t nearest, double nearestSquared, double& nearestDistance) {
+    if (nearest == testIndex) { // No other instance to compare against
+        nearestDistance = numeric_limits<double>::max();
+        return -1;
     }
-    */
 
-    return filteredData;
-}
-
-// Calculates the Euclidean distance between two feature vectors.
-// Sums the squared differences for each feature and takes the square root of the total.
-double calculateDistance(const vector<double>& a, const vector<double>& b) {
-    double distance = 0.0;
-    for (size_t i = 0; i < a.size(); ++i) {
-        distance += pow(a[i] - b[i], 2);
-    }
-    return sqrt(distance);
-}
-
-// Predicts the label of a test instance using the Nearest Neighbor algorithm.
-// Finds the closest instance in the training set (based on Euclidean distance) and returns its label.
-int predictLabel(const Instance& testInstance, const vector<Instance>& trainingSet) {
-    double minDistance = numeric_limits<double>::max();
-    int predictedLabel = -1;
-
-    // Compare the test instance to each training instance
-    for (const auto& trainInstance : trainingSet) {
-        double distance = calculateDistance(testInstance.features, trainInstance.features);
-        if (distance < minDistance) { // Update if a closer instance is found
-            minDistance = distance;
-            predictedLabel = trainInstance.label;
-        }
-    }
-    return predictedLabel;
+    nearestDistance = sqrt(nearestSquared);
+    return search.data->labels[nearest];
 }
 
 // Evaluates the classifier using Leave-One-Out Validation (LOO).
 // For each instance in the dataset, uses the remaining instances as the training set and
 // the current instance as the test instance, and checks the prediction.
-double leaveOneOutValidation(vector<Instance>& data) {
+// The dataset is only read, never copied. Held-out rows are predicted in parallel chunks
+// and the per-instance lines are printed afterwards in row order. When the early-abandon scan
+// is used, the share of feature dimensions it skipped is reported too.
+double leaveOneOutValidation(const FeatureMatrix& data, ThreadPool& pool, NeighborMethod neighborMethod) {
+    vector<int> predictedLabels(data.numRows);
+    vector<double> nearestDistances(data.numRows);
+
+    vector<int> allFeatures;
+    for (size_t f = 1; f <= data.numFeatures; ++f) allFeatures.push_back(f);
+    NeighborSearch search = prepareNeighborSearch(data, allFeatures, neighborMethod);
+
+    size_t numChunks = (data.numRows + LOO_ROWS_PER_TASK - 1) / LOO_ROWS_PER_TASK;
+    vector<PruningCounters> chunkPruning(numChunks);
+
+    pool.parallelForRange(data.numRows, LOO_ROWS_PER_TASK, [&](size_t begin, size_t end) {
+        size_t queries[LOO_ROWS_PER_TASK], nearestRows[LOO_ROWS_PER_TASK];
+        double nearestSquared[LOO_ROWS_PER_TASK];
+        for (size_t blockStart = begin; blockStart < end; blockStart += LOO_ROWS_PER_TASK) {
+            size_t count = min(end - blockStart, LOO_ROWS_PER_TASK);
+            for (size_t q = 0; q < count; ++q) queries[q] = blockStart + q;
+            findNearestBatch(search, queries, count, nearestRows, nearestSquared, chunkPruning[begin / LOO_ROWS_PER_TASK]);
+            for (size_t q = 0; q < count; ++q) {
+                size_t i = blockStart + q;
+                predictedLabels[i] = predictLabel(search, i, nearestRows[q], nearestSquared[q], nearestDistances[i]);
+            }
+        }
+    });
+
     int correctPredictions = 0;
 
     cout << "Instance | Predicted: | Actual: | Distance | Result:" << endl;
 
-    for (size_t i = 0; i < data.size(); ++i) {
-        // Prepare the training set by excluding the current test instance
-        vector<Instance> trainingSet = data;
-        Instance testInstance = trainingSet[i];
-        trainingSet.erase(trainingSet.begin() + i);
-
-        // Predict the label for the test instance
-        int predictedLabel = predictLabel(testInstance, trainingSet);
-        double minDistance = calculateDistance(testInstance.features, trainingSet[0].features);
+    for (size_t i = 0; i < data.numRows; ++i) {
+        int actualLabel = data.labels[i];
+        int predictedLabel = predictedLabels[i];
 
         // Determine whether the prediction is correct
-        string result = (predictedLabel == testInstance.label) ? "Correct" : "Incorrect";
+        string result = (predictedLabel == actualLabel) ? "Correct" : "Incorrect";
 
         // Output the prediction result for the current instance
         cout << setw(9) << i + 1 << " | "
              << setw(10) << predictedLabel << " | "
-             << setw(7) << testInstance.label << " | "
-             << setw(8) << fixed << setprecision(6) << minDistance << " | "
+             << setw(7) << actualLabel << " | "
+             << setw(8) << fixed << setprecision(6) << nearestDistances[i] << " | "
              << result << endl;
 
-        if (predictedLabel == testInstance.label) {
+        if (predictedLabel == actualLabel) {
             ++correctPredictions; // Increment count of correct predictions
         }
     }
 
+    if (search.method == NeighborMethod::EarlyAbandon) {
+        PruningCounters pruning;
+        for (const auto& counters : chunkPruning) pruning.add(counters);
+        cout << "Early abandon computed " << pruning.dimensionsComputed << " of " << pruning.dimensionsTotal
+             << " feature dimensions (" << fixed << setprecision(1) << pruning.skippedFraction() * 100.0 << "% skipped)" << endl;
+    }
+
     // Return the overall accuracy as a percentage
-    return static_cast<double>(correctPredictions) / data.size() * 100.0;
+    return static_cast<double>(correctPredictions) / data.numRows * 100.0;
 }
 
-int main() {
-    vector<Instance> instances;
+// Usage: ./a.out [--threads N] [--nn auto|brute|early|kd|vp|gemm]
+int main(int argc, char* argv[]) {
+    // Held-out rows are evaluated on this many threads (default: every core)
+    int numThreads = max(1u, thread::hardware_concurrency());
+    NeighborMethod neighborMethod = NeighborMethod::Auto;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            numThreads = max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--nn") == 0 && i + 1 < argc && parseNeighborMethod(argv[i + 1], neighborMethod)) {
+            ++i;
+        } else {
+            cerr << "Usage: " << argv[0] << " [--threads N] [--nn auto|brute|early|kd|vp|gemm]" << endl;
+            return 1;
+        }
+    }
+    ThreadPool pool(numThreads);
+
+    FeatureMatrix instances;
     string datasetFilename;
     int datasetChoice;
 
@@ -220,19 +139,29 @@ int main() {
         return 1;
     }
 
-    // Timing for dataset parsing
-    auto startParse = high_resolution_clock::now();
-    parseDataset(datasetFilename, instances);
-    auto endParse = high_resolution_clock::now();
-    cout << "Step 1: Dataset parsing completed in " 
-         << duration_cast<milliseconds>(endParse - startParse).count() << " ms" << endl;
-
-    // Timing for normalization
-    auto startNormalize = high_resolution_clock::now();
-    normalizeFeatures(instances);
-    auto endNormalize = high_resolution_clock::now();
-    cout << "Step 2: Feature normalization completed in " 
-         << duration_cast<milliseconds>(endNormalize - startNormalize).count() << " ms" << endl;
+    // A current binary cache replaces both parsing and normalization
+    auto startCache = high_resolution_clock::now();
+    bool cached = loadDatasetCache(datasetFilename, instances);
+    auto endCache = high_resolution_clock::now();
+    if (cached) {
+        cout << "Step 1: Normalized dataset loaded from " << datasetCachePath(datasetFilename) << " in "
+             << duration_cast<microseconds>(endCache - startCache).count() << " us" << endl;
+    } else {
+        // Timing for dataset parsing
+        auto startParse = high_resolution_clock::now();
+        parseDataset(datasetFilename, instances, &pool);
+        auto endParse = high_resolution_clock::now();
+        cout << "Step 1: Dataset parsing completed in " 
+             << duration_cast<milliseconds>(endParse - startParse).count() << " ms" << endl;
+
+        // Timing for normalization
+        auto startNormalize = high_resolution_clock::now();
+        normalizeFeatures(instances);
+        auto endNormalize = high_resolution_clock::now();
+        cout << "Step 2: Feature normalization completed in " 
+             << duration_cast<milliseconds>(endNormalize - startNormalize).count() << " ms" << endl;
+        writeDatasetCache(datasetFilename, instances);
+    }
 
     cout << "Parse entire dataset or only certain features?" << endl;
     cout << "1. Entire dataset" << endl;
@@ -261,7 +190,7 @@ int main() {
 
     // Timing for leave-one-out validation
     auto startValidation = high_resolution_clock::now();
-    double accuracy = leaveOneOutValidation(instances);
+    double accuracy = leaveOneOutValidation(instances, pool, neighborMethod);
     auto endValidation = high_resolution_clock::now();
     cout << "Step 4: Leave-One-Out Validation completed in " 
          << duration_cast<milliseconds>(endValidation - startValidation).count() << " ms" << endl;
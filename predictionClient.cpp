@@ -0,0 +1,238 @@
+// Client and load generator for the prediction server (./a.out --data FILE --features 1,2,... --serve SOCKET).
+// With --query it replays the rows of a file as predict requests over C connections, each keeping up to P
+// requests in flight, and reports requests/sec, the round-trip latency percentiles seen by the clients and the
+// server's own figures. --subset switches the server to another feature subset and --stats prints its figures.
+//
+// Build: g++ -O2 -std=c++17 -pthread predictionClient.cpp -o predictionClient
+// Usage: ./predictionClient SOCKET --query FILE [--connections C] [--pipeline P] [--requests N]
+//        ./predictionClient SOCKET --subset 1,5,7
+//        ./predictionClient SOCKET --stats
+//        C defaults to 4, P to 1 (one request at a time per connection), N to one request per row of FILE.
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <deque>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <charconv> // For to_chars and from_chars
+#include <cstring>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <sys/un.h> // For sockaddr_un
+#include <unistd.h> // For read, write and close
+
+#include "featureMatrix.h"
+#include "datasetParser.h"
+#include "predictionServer.h" // For nearestRankPercentile
+
+using namespace std;
+
+// Connects to the server listening on `path`; exits with a message if nobody is
+int connectToServer(const string& path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        cerr << "Error: Socket path " << path << " is too long" << endl;
+        exit(1);
+    }
+    copy(path.begin(), path.end(), address.sun_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        cerr << "Error: Unable to connect to " << path << ": " << strerror(errno) << endl;
+        exit(1);
+    }
+    return fd;
+}
+
+// Writes all of `text`; exits if the server went away
+void sendAll(int fd, const string& text) {
+    for (size_t sent = 0; sent < text.size();) {
+        ssize_t written = send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+        if (written <= 0) {
+            cerr << "Error: The server closed the connection" << endl;
+            exit(1);
+        }
+        sent += static_cast<size_t>(written);
+    }
+}
+
+// Answer lines read from a connection through a buffer
+class LineReader {
+public:
+    explicit LineReader(int fd) : fd(fd) {}
+
+    // Next answer without its newline; exits if the server went away first
+    string next() {
+        for (;;) {
+            size_t newline = buffer.find('\n', start);
+            if (newline != string::npos) {
+                string line = buffer.substr(start, newline - start);
+                start = newline + 1;
+                return line;
+            }
+            buffer.erase(0, start);
+            start = 0;
+            char chunk[1 << 16];
+            ssize_t got = read(fd, chunk, sizeof(chunk));
+            if (got <= 0) {
+                cerr << "Error: The server closed the connection" << endl;
+                exit(1);
+            }
+            buffer.append(chunk, static_cast<size_t>(got));
+        }
+    }
+
+private:
+    int fd;
+    string buffer;
+    size_t start = 0;
+};
+
+// Sends one request and returns its answer
+string ask(const string& socketPath, const string& request) {
+    int fd = connectToServer(socketPath);
+    sendAll(fd, request + "\n");
+    LineReader reader(fd);
+    string answer = reader.next();
+    close(fd);
+    return answer;
+}
+
+// "predict v1 ... vF\n" for every row, with each raw value written so it parses back to the same double
+vector<string> buildRequests(const FeatureMatrix& rows) {
+    vector<string> requests(rows.numRows);
+    char digits[32];
+    for (size_t r = 0; r < rows.numRows; ++r) {
+        string& request = requests[r];
+        request = "predict";
+        for (size_t f = 0; f < rows.numFeatures; ++f) {
+            request.push_back(' ');
+            request.append(digits, to_chars(digits, digits + sizeof(digits), rows.at(r, f)).ptr);
+        }
+        request.push_back('\n');
+    }
+    return requests;
+}
+
+// What one load-generating connection saw
+struct ConnectionResult {
+    vector<double> latencies; // Round trip of each request, in microseconds
+    size_t matches = 0;       // Answers equal to the row's label
+    size_t errors = 0;        // Answers that were not a label
+};
+
+// Sends requests first, first + step, ... (below `total`) on a connection of its own, keeping up to `pipeline`
+// of them in flight; request r is row r of the file, wrapping around
+ConnectionResult generateLoad(const string& socketPath, const vector<string>& requests, const vector<int>& labels, size_t first,
+                              size_t step, size_t total, size_t pipeline) {
+    ConnectionResult result;
+    int fd = connectToServer(socketPath);
+    LineReader reader(fd);
+    deque<pair<chrono::steady_clock::time_point, size_t>> inFlight; // Send time and row of each unanswered request
+    string batch;
+    size_t nextRequest = first;
+    while (nextRequest < total || !inFlight.empty()) {
+        batch.clear();
+        auto now = chrono::steady_clock::now();
+        while (nextRequest < total && inFlight.size() < pipeline) {
+            size_t row = nextRequest % requests.size();
+            batch += requests[row];
+            inFlight.push_back({now, row});
+            nextRequest += step;
+        }
+        if (!batch.empty()) sendAll(fd, batch);
+
+        string answer = reader.next();
+        auto answered = chrono::steady_clock::now();
+        result.latencies.push_back(chrono::duration<double, micro>(answered - inFlight.front().first).count());
+        int label;
+        if (from_chars(answer.data(), answer.data() + answer.size(), label).ec != errc()) ++result.errors;
+        else if (label == labels[inFlight.front().second]) ++result.matches;
+        inFlight.pop_front();
+    }
+    close(fd);
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " SOCKET --query FILE [--connections C] [--pipeline P] [--requests N] | --subset 1,5,7 | --stats" << endl;
+        return 1;
+    }
+    string socketPath = argv[1];
+    string queryPath, subset;
+    bool printStats = false;
+    size_t numConnections = 4, pipeline = 1, numRequests = 0;
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--query") == 0 && i + 1 < argc) {
+            queryPath = argv[++i];
+        } else if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 1) {
+            numConnections = static_cast<size_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 1) {
+            pipeline = static_cast<size_t>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--requests") == 0 && i + 1 < argc && atol(argv[i + 1]) >= 1) {
+            numRequests = static_cast<size_t>(atol(argv[++i]));
+        } else if (strcmp(argv[i], "--subset") == 0 && i + 1 < argc) {
+            subset = argv[++i];
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            printStats = true;
+        } else {
+            cerr << "Usage: " << argv[0] << " SOCKET --query FILE [--connections C] [--pipeline P] [--requests N] | --subset 1,5,7 | --stats" << endl;
+            return 1;
+        }
+    }
+
+    if (!subset.empty()) {
+        string answer = ask(socketPath, "subset " + subset);
+        cout << answer << endl;
+        return answer.compare(0, 2, "ok") == 0 ? 0 : 1;
+    }
+    if (queryPath.empty()) {
+        if (!printStats) {
+            cerr << "Error: Nothing to do; give --query, --subset or --stats" << endl;
+            return 1;
+        }
+        cout << ask(socketPath, "stats") << endl;
+        return 0;
+    }
+
+    FeatureMatrix rows; // Raw values: the server normalizes them with its training set's ranges
+    parseDataset(queryPath, rows);
+    if (rows.numRows == 0) {
+        cerr << "Error: " << queryPath << " has no rows" << endl;
+        return 1;
+    }
+    vector<string> requests = buildRequests(rows);
+    if (numRequests == 0) numRequests = rows.numRows;
+
+    vector<ConnectionResult> results(numConnections);
+    vector<thread> connections;
+    auto start = chrono::steady_clock::now();
+    for (size_t c = 0; c < numConnections; ++c) {
+        connections.emplace_back([&, c] {
+            results[c] = generateLoad(socketPath, requests, rows.labels, c, numConnections, numRequests, pipeline);
+        });
+    }
+    for (thread& connection : connections) connection.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<double> latencies;
+    size_t matches = 0, errors = 0;
+    for (const ConnectionResult& result : results) {
+        latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+        matches += result.matches;
+        errors += result.errors;
+    }
+    double maxLatency = *max_element(latencies.begin(), latencies.end());
+    cout << fixed << setprecision(1) << "Sent " << numRequests << " requests over " << numConnections << " connections (pipeline "
+         << pipeline << ") in " << seconds * 1000.0 << " ms: " << setprecision(0) << numRequests / seconds << " requests/sec" << endl;
+    cout << setprecision(1) << "Round-trip latency: p50 " << nearestRankPercentile(latencies, 50.0) << " us, p99 "
+         << nearestRankPercentile(latencies, 99.0) << " us, max " << maxLatency << " us" << endl;
+    cout << static_cast<double>(matches) / numRequests * 100.0 << "% of answers match the file's label column";
+    if (errors > 0) cout << ", " << errors << " errors";
+    cout << endl;
+    cout << "Server: " << ask(socketPath, "stats") << endl;
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,349 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <chrono>
+#include <algorithm>
+#include <charconv>    // For to_chars
+#include <cerrno>
+#include <cmath>       // For isfinite
+#include <csignal>     // For SIGINT, SIGTERM and SIGPIPE
+#include <cstring>     // For strerror
+#include <fcntl.h>     // For fcntl
+#include <poll.h>      // For poll
+#include <sys/socket.h>
+#include <sys/un.h>    // For sockaddr_un
+#include <unistd.h>    // For close and unlink
+
+#include "featureMatrix.h"
+#include "datasetParser.h"
+#include "batchPrediction.h"
+#include "featureSearch.h" // For featureSetString
+#include "threadPool.h"
+
+using namespace std;
+
+// Long-running 1-NN prediction over a Unix domain socket. The training set is loaded, normalized and indexed
+// once; clients then send one request per line and get one response line per request, in the order each
+// connection sent them:
+//   predict v1 v2 ... vF   raw values of all F features of one row (the training file's layout) -> "<label>";
+//                          every value must be finite and the subset's within PREDICT_MAX_NORMALIZED of the range
+//   subset 1,5,7           switch to a new 1-based subset without a restart; earlier requests still use the old
+//                          one -> "ok {1,5,7}"
+//   stats                  -> "requests N batches B mean_batch M p50_us P p99_us Q"
+// and "error <reason>" for anything malformed. One thread runs a poll() loop over every connection. Requests
+// queue up in the socket buffers while a batch is being classified, and the next batch takes all of them: a batch
+// runs as soon as a poll finds no more input waiting, at SERVER_MAX_BATCH requests, or once its oldest request has
+// waited SERVER_BATCH_WAIT under a steady stream. Batches so grow with the load, while a lone request never waits
+// on a timer. Each batch goes through predictBlock, spread over the pool. Latency is measured from the moment a
+// request is read to the moment its answer is queued for sending. A connection is not read while more than
+// SERVER_MAX_OUTPUT_BYTES of its answers wait to be sent, and one whose unfinished line outgrows
+// SERVER_INPUT_LINES legal lines is answered "error" and closed, so no client can grow the server's buffers
+// (its sending side is shut first and later input dropped, since closing on unread input would lose the answer).
+
+const size_t SERVER_MAX_BATCH = 1024;                        // Requests classified together at most
+const chrono::microseconds SERVER_BATCH_WAIT(200);           // Longest a request waits while more keep arriving
+const size_t SERVER_LATENCY_WINDOW = 1 << 16;                // Latest requests the percentiles cover
+const size_t SERVER_READ_BYTES = 1 << 16;                    // Bytes read from a connection at a time
+const size_t SERVER_MAX_FIELD_BYTES = 32;                    // Longest field a legal line needs (a double is 24)
+const size_t SERVER_INPUT_LINES = 4;                         // Longest legal lines an unfinished line may span
+const size_t SERVER_MAX_OUTPUT_BYTES = 1 << 20;              // Queued answers above which a client is not read
+
+// Set by SIGINT and SIGTERM; the loop finishes its batch, reports and removes the socket
+inline volatile sig_atomic_t serverStopRequested = 0;
+
+inline void requestServerStop(int) {
+    serverStopRequested = 1;
+}
+
+// Nearest-rank percentile (0 < percent <= 100) of `values`, which are reordered
+inline double nearestRankPercentile(vector<double>& values, double percent) {
+    if (values.empty()) return 0.0;
+    size_t rank = static_cast<size_t>(percent / 100.0 * values.size() + 0.999999);
+    auto nth = values.begin() + (min(values.size(), max<size_t>(rank, 1)) - 1);
+    nth_element(values.begin(), nth, values.end());
+    return *nth;
+}
+
+// Request counts and a ring of the latest SERVER_LATENCY_WINDOW latencies
+class LatencyRecorder {
+public:
+    void record(double microseconds) {
+        if (latencies.size() < SERVER_LATENCY_WINDOW) latencies.push_back(microseconds);
+        else latencies[requests % SERVER_LATENCY_WINDOW] = microseconds;
+        ++requests;
+    }
+
+    void recordBatch() { ++batches; }
+
+    string summary() const {
+        vector<double> window = latencies;
+        double p50 = nearestRankPercentile(window, 50.0), p99 = nearestRankPercentile(window, 99.0);
+        char text[160];
+        snprintf(text, sizeof(text), "requests %zu batches %zu mean_batch %.1f p50_us %.1f p99_us %.1f", requests, batches,
+                 batches == 0 ? 0.0 : static_cast<double>(requests) / batches, p50, p99);
+        return text;
+    }
+
+private:
+    size_t requests = 0;
+    size_t batches = 0;
+    vector<double> latencies;
+};
+
+// One client connection: bytes read but not yet split into lines, and answers not yet sent
+struct ServerConnection {
+    int fd = -1;
+    string input;
+    string output;
+    size_t awaiting = 0;      // Its predictions still in the pending batch
+    bool inputClosed = false; // The client finished sending; the connection closes once every answer is out
+    bool discarding = false;  // Its line outgrew the limit: input is dropped, and the answers end once sent
+    bool outputShut = false;  // Its sending side is shut
+};
+
+// A predict request waiting for its batch
+struct PendingPrediction {
+    uint64_t connection;                     // Key of the connection that sent it
+    chrono::steady_clock::time_point arrival;
+};
+
+// Opens a listening Unix domain socket at `path`, replacing a stale socket file; -1 with a message on failure
+inline int listenOnUnixSocket(const string& path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        cerr << "Error: Socket path " << path << " is too long" << endl;
+        return -1;
+    }
+    copy(path.begin(), path.end(), address.sun_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path.c_str()); // A socket file left behind by a server that did not shut down
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        cerr << "Error: Unable to listen on " << path << ": " << strerror(errno) << endl;
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+// Longest legal request line for a `numFeatures`-wide dataset: the command and one full-length field per feature
+inline size_t serverMaxLineBytes(size_t numFeatures) {
+    return (numFeatures + 1) * SERVER_MAX_FIELD_BYTES;
+}
+
+// Parses "1,5,7" into 1-based features of a `numFeatures`-wide dataset; false if empty or out of range
+inline bool parseServerSubset(const char* p, const char* end, size_t numFeatures, vector<int>& features) {
+    features.clear();
+    while (p < end) {
+        int feature = 0;
+        from_chars_result result = from_chars(p, end, feature);
+        if (result.ec != errc() || feature < 1 || static_cast<size_t>(feature) > numFeatures) return false;
+        features.push_back(feature);
+        p = result.ptr;
+        if (p < end && *p != ',') return false;
+        p += p < end;
+    }
+    return !features.empty();
+}
+
+// Serves predictions for `training` (loaded and normalized) on `socketPath` until SIGINT or SIGTERM, starting
+// with the 1-based `features`. Returns the process exit status.
+inline int runPredictionServer(const string& socketPath, const FeatureMatrix& training, const vector<int>& features, ThreadPool& pool) {
+    int listener = listenOnUnixSocket(socketPath);
+    if (listener < 0) return 1;
+    signal(SIGINT, requestServerStop);
+    signal(SIGTERM, requestServerStop);
+    signal(SIGPIPE, SIG_IGN); // A client that hangs up is noticed by send instead
+
+    PredictionModel model = buildPredictionModel(training, features);
+    cerr << "Serving " << training.numRows << " rows on " << socketPath << " with subset " << featureSetString(features)
+         << (model.useGemm ? " (gemm)" : " (column scan)") << endl;
+
+    unordered_map<uint64_t, ServerConnection> connections;
+    uint64_t nextConnection = 0;
+    vector<PendingPrediction> pending;
+    vector<double> points;  // Row-major normalized subset values of the pending requests
+    vector<int> predicted;
+    LatencyRecorder recorder;
+
+    // Classifies every pending request and queues the answers
+    auto runBatch = [&]() {
+        if (pending.empty()) return;
+        predicted.resize(pending.size());
+        predictBlock(model, points.data(), pending.size(), predicted.data(), pool);
+        auto now = chrono::steady_clock::now();
+        char digits[16];
+        for (size_t r = 0; r < pending.size(); ++r) {
+            recorder.record(chrono::duration<double, micro>(now - pending[r].arrival).count());
+            auto connection = connections.find(pending[r].connection);
+            if (connection == connections.end()) continue; // The client hung up before its answer was ready
+            --connection->second.awaiting;
+            char* stop = to_chars(digits, digits + sizeof(digits), predicted[r]).ptr;
+            connection->second.output.append(digits, stop).push_back('\n');
+        }
+        recorder.recordBatch();
+        pending.clear();
+        points.clear();
+    };
+
+    // Handles one request line from `key`; predictions only join the pending batch
+    vector<double> values(training.numFeatures);
+    vector<int> newFeatures;
+    auto handleLine = [&](uint64_t key, const char* p, const char* end, chrono::steady_clock::time_point arrival) {
+        while (p < end && isFieldSpace(*p)) ++p;
+        const char* word = p;
+        while (p < end && !isFieldSpace(*p)) ++p;
+        string command(word, p);
+        string answer;
+        if (command == "predict") {
+            size_t count = 0;
+            double value;
+            bool malformed = false, finite = true;
+            while (count <= training.numFeatures && nextField(p, end, value, malformed)) {
+                if (count < training.numFeatures) values[count] = value;
+                finite = finite && isfinite(value);
+                ++count;
+            }
+            size_t first = points.size();
+            if (malformed || count != training.numFeatures) {
+                answer = "error expected " + to_string(training.numFeatures) + " feature values";
+            } else if (!finite) {
+                answer = "error feature values must be finite"; // As the file parser requires of the training set
+            } else {
+                points.resize(first + model.features.size());
+                if (normalizeQuery(model, values.data(), &points[first])) {
+                    pending.push_back({key, arrival});
+                    ++connections[key].awaiting;
+                    if (pending.size() >= SERVER_MAX_BATCH) runBatch();
+                    return;
+                }
+                points.resize(first);
+                answer = "error feature values too far outside the training range";
+            }
+        } else {
+            runBatch(); // Everything this connection sent before the command is answered first
+            if (command == "subset") {
+                while (p < end && isFieldSpace(*p)) ++p;
+                const char* listEnd = p;
+                while (listEnd < end && !isFieldSpace(*listEnd)) ++listEnd;
+                if (parseServerSubset(p, listEnd, training.numFeatures, newFeatures)) {
+                    model = buildPredictionModel(training, newFeatures);
+                    answer = "ok " + featureSetString(newFeatures);
+                    cerr << "Switched to subset " << featureSetString(newFeatures) << (model.useGemm ? " (gemm)" : " (column scan)") << endl;
+                } else {
+                    answer = "error expected features 1 to " + to_string(training.numFeatures) + ", like 1,5,7";
+                }
+            } else if (command == "stats") {
+                answer = recorder.summary();
+            } else {
+                answer = "error unknown request";
+            }
+        }
+        connections[key].output.append(answer).push_back('\n');
+    };
+
+    size_t inputLimit = SERVER_INPUT_LINES * serverMaxLineBytes(training.numFeatures);
+    vector<pollfd> polled;
+    vector<uint64_t> polledKeys; // Connection of each polled descriptor after the listener
+    char buffer[SERVER_READ_BYTES];
+    while (!serverStopRequested) {
+        polled.assign(1, {listener, POLLIN, 0});
+        polledKeys.clear();
+        for (const auto& entry : connections) {
+            bool reading = !entry.second.inputClosed && entry.second.output.size() < SERVER_MAX_OUTPUT_BYTES;
+            short events = (reading ? POLLIN : 0) | (entry.second.output.empty() ? 0 : POLLOUT);
+            polled.push_back({entry.second.fd, events, 0});
+            polledKeys.push_back(entry.first);
+        }
+
+        // With requests pending, only look for input that has already arrived
+        int timeout = pending.empty() ? 1000 : 0; // 1 s bounds how long a stop request can go unnoticed
+        int ready = poll(polled.data(), polled.size(), timeout);
+        if (ready < 0 && errno != EINTR) {
+            cerr << "Error: poll failed: " << strerror(errno) << endl;
+            break;
+        }
+        if (ready <= 0) { // Nothing new arrived: the waiting requests go now
+            runBatch();
+        }
+
+        if (ready > 0 && (polled[0].revents & POLLIN)) {
+            int client;
+            while ((client = accept(listener, nullptr, nullptr)) >= 0) {
+                fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+                connections[nextConnection++].fd = client;
+            }
+        }
+
+        for (size_t c = 1; ready > 0 && c < polled.size(); ++c) {
+            if (!(polled[c].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            uint64_t key = polledKeys[c - 1];
+            ServerConnection& connection = connections[key];
+            bool failed = false;
+            // Each read's complete lines are handled before the next read, so only an unfinished line is buffered
+            while (!connection.inputClosed && connection.output.size() < SERVER_MAX_OUTPUT_BYTES) {
+                ssize_t got = recv(connection.fd, buffer, sizeof(buffer), 0);
+                if (got == 0) connection.inputClosed = true;
+                else if (got < 0) failed = errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR;
+                if (got <= 0) break;
+
+                if (connection.discarding) continue;
+                connection.input.append(buffer, static_cast<size_t>(got));
+                auto arrival = chrono::steady_clock::now();
+                size_t start = 0;
+                for (size_t newline; (newline = connection.input.find('\n', start)) != string::npos; start = newline + 1) {
+                    handleLine(key, connection.input.data() + start, connection.input.data() + newline, arrival);
+                }
+                connection.input.erase(0, start);
+                if (connection.input.size() > inputLimit) {
+                    connection.output.append("error request line longer than " + to_string(inputLimit) + " bytes\n");
+                    connection.input.clear();
+                    connection.input.shrink_to_fit();
+                    connection.discarding = true;
+                }
+            }
+            if (failed) {
+                close(connection.fd);
+                connections.erase(key);
+            }
+        }
+
+        // A full batch already ran inside handleLine; a partial one runs once its oldest request has waited enough
+        if (!pending.empty() && chrono::steady_clock::now() - pending.front().arrival >= SERVER_BATCH_WAIT) runBatch();
+
+        for (auto entry = connections.begin(); entry != connections.end();) {
+            ServerConnection& connection = entry->second;
+            bool failed = false;
+            while (!connection.output.empty()) {
+                ssize_t sent = send(connection.fd, connection.output.data(), connection.output.size(), MSG_NOSIGNAL);
+                if (sent > 0) connection.output.erase(0, static_cast<size_t>(sent));
+                else {
+                    failed = errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR;
+                    break;
+                }
+            }
+            if (!failed && connection.discarding && !connection.outputShut && connection.awaiting == 0 && connection.output.empty()) {
+                shutdown(connection.fd, SHUT_WR); // The client reads the error, then end of file
+                connection.outputShut = true;
+            }
+            if (failed || (connection.inputClosed && connection.awaiting == 0 && connection.output.empty())) {
+                close(connection.fd);
+                entry = connections.erase(entry);
+            } else {
+                ++entry;
+            }
+        }
+    }
+
+    runBatch();
+    for (auto& entry : connections) close(entry.second.fd);
+    close(listener);
+    unlink(socketPath.c_str());
+    cerr << "Stopped: " << recorder.summary() << endl;
+    return 0;
+}
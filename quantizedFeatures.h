@@ -0,0 +1,433 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <limits>
+#include <memory>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <type_traits>
+
+#include "featureMatrix.h"
+#include "threadPool.h"
+#include "boundedScoring.h"
+#include "distanceCache.h"
+
+using namespace std;
+
+// Element type used to store the normalized feature columns.
+// Normalized features live in [0, 1], so nearest-neighbor ranking rarely needs a full double:
+// float32 halves the memory traffic, and the fixed-point types quarter or eighth it.
+enum class FeaturePrecision {
+    Float64, // FeatureMatrix as parsed (the reference)
+    Float32, // float columns, float distances
+    Int16,   // [0, 1] scaled to 0..65535, exact int64 distances
+    Int8     // [0, 1] scaled to 0..255, exact int32 distances
+};
+
+// Parses a --precision value ("f64", "f32", "i16" or "i8"); returns false if it is not recognized
+inline bool parseFeaturePrecision(const string& name, FeaturePrecision& precision) {
+    if (name == "f64") precision = FeaturePrecision::Float64;
+    else if (name == "f32") precision = FeaturePrecision::Float32;
+    else if (name == "i16") precision = FeaturePrecision::Int16;
+    else if (name == "i8") precision = FeaturePrecision::Int8;
+    else return false;
+    return true;
+}
+
+inline const char* featurePrecisionName(FeaturePrecision precision) {
+    switch (precision) {
+    case FeaturePrecision::Float32: return "f32";
+    case FeaturePrecision::Int16: return "i16";
+    case FeaturePrecision::Int8: return "i8";
+    default: return "f64";
+    }
+}
+
+// Per-type storage details. Integer squared differences are summed exactly: an int8 difference squared is
+// at most 255^2, so int32 holds the sum of 33000 columns; int16 needs int64.
+template <typename T> struct QuantizedTraits;
+
+template <> struct QuantizedTraits<float> {
+    using Distance = float;
+    // Subtracted float sums within this much (per committed column) of the best are re-summed, see
+    // evaluateFeatureRemoval; float rounding is about 1e-7 of the distance, which is at most the width
+    static constexpr float tieTolerancePerColumn = 1e-5f;
+    static float quantize(double value) { return static_cast<float>(value); }
+};
+
+template <> struct QuantizedTraits<uint16_t> {
+    using Distance = int64_t;
+    static uint16_t quantize(double value) { return static_cast<uint16_t>(lround(value * 65535.0)); }
+};
+
+template <> struct QuantizedTraits<uint8_t> {
+    using Distance = int32_t;
+    static uint8_t quantize(double value) { return static_cast<uint8_t>(lround(value * 255.0)); }
+};
+
+// Column-major copy of a normalized FeatureMatrix stored as T, laid out like FeatureMatrix
+// (every column starts on a COLUMN_ALIGNMENT boundary)
+template <typename T>
+struct QuantizedMatrix {
+    size_t numRows = 0;
+    size_t numFeatures = 0;
+    size_t stride = 0; // Elements between the start of one column and the next
+    vector<int> labels;
+    shared_ptr<T> values;
+
+    const T* column(size_t feature) const { return values.get() + feature * stride; }
+    size_t size() const { return numRows; }
+};
+
+// Rounds every value of the normalized `data` to T
+template <typename T>
+QuantizedMatrix<T> quantizeFeatures(const FeatureMatrix& data) {
+    QuantizedMatrix<T> matrix;
+    matrix.numRows = data.numRows;
+    matrix.numFeatures = data.numFeatures;
+    matrix.labels = data.labels;
+
+    size_t perLine = COLUMN_ALIGNMENT / sizeof(T);
+    matrix.stride = max<size_t>((data.numRows + perLine - 1) / perLine * perLine, perLine);
+    size_t bytes = matrix.stride * max<size_t>(data.numFeatures, 1) * sizeof(T);
+    T* buffer = static_cast<T*>(aligned_alloc(COLUMN_ALIGNMENT, bytes));
+    if (buffer == nullptr) {
+        cerr << "Error: Unable to allocate " << bytes << " bytes for the quantized features" << endl;
+        exit(1);
+    }
+    fill(buffer, buffer + bytes / sizeof(T), T());
+    matrix.values = shared_ptr<T>(buffer, free);
+
+    for (size_t f = 0; f < data.numFeatures; ++f) {
+        const double* source = data.column(f);
+        T* target = buffer + f * matrix.stride;
+        for (size_t row = 0; row < data.numRows; ++row) target[row] = QuantizedTraits<T>::quantize(source[row]);
+    }
+    return matrix;
+}
+
+// ---------------- Kernels ----------------
+// The same loops as the double kernels in distanceKernels.h, written once as templates. The AVX2 copies let
+// the compiler vectorize them 8 (float, int32) or 4 (int64) lanes wide; the difference is taken in the
+// distance type, so unsigned columns never wrap.
+
+template <typename T, typename D>
+__attribute__((optimize("fp-contract=off")))
+inline void addSquaredColumnQuantized(const D* base, const T* __restrict column, D testValue, D* out, size_t n) {
+    for (size_t j = 0; j < n; ++j) {
+        D diff = testValue - static_cast<D>(column[j]);
+        out[j] = base[j] + diff * diff;
+    }
+}
+
+template <typename T, typename D>
+__attribute__((optimize("fp-contract=off")))
+inline void subtractSquaredColumnQuantized(const D* base, const T* __restrict column, D testValue, D* out, size_t n) {
+    for (size_t j = 0; j < n; ++j) {
+        D diff = testValue - static_cast<D>(column[j]);
+        out[j] = base[j] - diff * diff;
+    }
+}
+
+template <typename T, typename D>
+__attribute__((target("avx2"), optimize("fp-contract=off", "tree-vectorize")))
+inline void addSquaredColumnQuantizedAvx2(const D* base, const T* __restrict column, D testValue, D* out, size_t n) {
+    for (size_t j = 0; j < n; ++j) {
+        D diff = testValue - static_cast<D>(column[j]);
+        out[j] = base[j] + diff * diff;
+    }
+}
+
+template <typename T, typename D>
+__attribute__((target("avx2"), optimize("fp-contract=off", "tree-vectorize")))
+inline void subtractSquaredColumnQuantizedAvx2(const D* base, const T* __restrict column, D testValue, D* out, size_t n) {
+    for (size_t j = 0; j < n; ++j) {
+        D diff = testValue - static_cast<D>(column[j]);
+        out[j] = base[j] - diff * diff;
+    }
+}
+
+// Index of the first smallest value in values[0, n): a min reduction the compiler can vectorize,
+// then a scan for the first index holding it
+template <typename D>
+inline size_t argminQuantized(const D* values, size_t n) {
+    D minimum = values[0];
+    for (size_t j = 1; j < n; ++j) minimum = values[j] < minimum ? values[j] : minimum;
+    size_t j = 0;
+    while (values[j] != minimum) ++j;
+    return j;
+}
+
+// Distances are finite and never -0, so the float min reduction may be reordered
+template <typename D>
+__attribute__((target("avx2"), optimize("tree-vectorize", "finite-math-only", "no-signed-zeros")))
+inline size_t argminQuantizedAvx2(const D* values, size_t n) {
+    D minimum = values[0];
+    for (size_t j = 1; j < n; ++j) minimum = values[j] < minimum ? values[j] : minimum;
+    size_t j = 0;
+    while (values[j] != minimum) ++j;
+    return j;
+}
+
+// Kernel pair for one storage type, picked once per process like distanceKernels()
+template <typename T>
+struct QuantizedKernels {
+    using D = typename QuantizedTraits<T>::Distance;
+    void (*addSquaredColumn)(const D* base, const T* column, D testValue, D* out, size_t n);
+    void (*subtractSquaredColumn)(const D* base, const T* column, D testValue, D* out, size_t n);
+    size_t (*argmin)(const D* values, size_t n);
+};
+
+template <typename T>
+const QuantizedKernels<T>& quantizedKernels() {
+    using D = typename QuantizedTraits<T>::Distance;
+    static const QuantizedKernels<T> selected = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return QuantizedKernels<T>{addSquaredColumnQuantizedAvx2<T, D>, subtractSquaredColumnQuantizedAvx2<T, D>, argminQuantizedAvx2<D>};
+        }
+        return QuantizedKernels<T>{addSquaredColumnQuantized<T, D>, subtractSquaredColumnQuantized<T, D>, argminQuantized<D>};
+    }();
+    return selected;
+}
+
+// Per-thread distance row for one distance type, reused across held-out rows
+template <typename D>
+D* quantizedScratchRow(size_t n) {
+    thread_local vector<D> buffer;
+    if (buffer.size() < n) {
+        buffer.resize(n);
+        countEvent(Counter::Allocations);
+    }
+    return buffer.data();
+}
+
+// ---------------- Search support ----------------
+// Mirrors distanceCache.h for quantized storage, with the same function names, so the search loops in
+// finalMain.cpp run unchanged on either representation.
+
+template <typename T>
+struct QuantizedDistanceCache {
+    using D = typename QuantizedTraits<T>::Distance;
+    size_t numRows = 0;
+    vector<int> features;     // Committed 1-based features, in the order they were added
+    vector<D> squaredDistances; // Row-major numRows x numRows partial sums
+    int subtractionsSinceRebuild = 0;
+};
+
+// The distance cache that goes with each dataset representation
+template <typename Dataset> struct DistanceCacheFor { using type = DistanceCache; };
+template <typename T> struct DistanceCacheFor<QuantizedMatrix<T>> { using type = QuantizedDistanceCache<T>; };
+
+template <typename T>
+void addFeatureToCache(QuantizedDistanceCache<T>& cache, const QuantizedMatrix<T>& data, int feature) {
+    using D = typename QuantizedTraits<T>::Distance;
+    const T* column = data.column(feature - 1);
+    const QuantizedKernels<T>& kernels = quantizedKernels<T>();
+    for (size_t i = 0; i < cache.numRows; ++i) {
+        D* row = &cache.squaredDistances[i * cache.numRows];
+        kernels.addSquaredColumn(row, column, static_cast<D>(column[i]), row, cache.numRows);
+    }
+    cache.features.push_back(feature);
+}
+
+template <typename T>
+void buildDistanceCache(QuantizedDistanceCache<T>& cache, const QuantizedMatrix<T>& data, const vector<int>& features) {
+    cache.numRows = data.numRows;
+    cache.features.clear();
+    cache.squaredDistances.assign(data.numRows * data.numRows, 0);
+    countEvent(Counter::Allocations);
+    cache.subtractionsSinceRebuild = 0;
+    for (int feature : features) addFeatureToCache(cache, data, feature);
+}
+
+// Integer sums are exact, so subtracting a column is exact too; float sums are rebuilt every
+// CACHE_REBUILD_INTERVAL removals exactly like the double cache
+template <typename T>
+void removeFeatureFromCache(QuantizedDistanceCache<T>& cache, const QuantizedMatrix<T>& data, int feature) {
+    using D = typename QuantizedTraits<T>::Distance;
+    auto committed = find(cache.features.begin(), cache.features.end(), feature);
+    if (committed == cache.features.end()) return; // Not in the sums (bidirectional search adds features the backward side already dropped)
+    cache.features.erase(committed);
+
+    if (is_floating_point<D>::value && ++cache.subtractionsSinceRebuild >= CACHE_REBUILD_INTERVAL) {
+        vector<int> remaining = cache.features;
+        buildDistanceCache(cache, data, remaining);
+        return;
+    }
+
+    const T* column = data.column(feature - 1);
+    const QuantizedKernels<T>& kernels = quantizedKernels<T>();
+    for (size_t i = 0; i < cache.numRows; ++i) {
+        D* row = &cache.squaredDistances[i * cache.numRows];
+        kernels.subtractSquaredColumn(row, column, static_cast<D>(column[i]), row, cache.numRows);
+    }
+}
+
+// Predicted label for held-out row i given its distances to every row (the row itself is skipped)
+template <typename T>
+int predictFromDistances(typename QuantizedTraits<T>::Distance* distances, size_t numRows, size_t i, const vector<int>& labels) {
+    using D = typename QuantizedTraits<T>::Distance;
+    distances[i] = numeric_limits<D>::max(); // Leave out the test instance
+    size_t nearest = quantizedKernels<T>().argmin(distances, numRows);
+    return nearest == i ? -1 : labels[nearest];
+}
+
+template <typename T>
+bool additionPredictsCorrectly(const QuantizedDistanceCache<T>& cache, const QuantizedMatrix<T>& data, int feature, size_t i, const NeighborVote& vote) {
+    using D = typename QuantizedTraits<T>::Distance;
+    const T* column = data.column(feature - 1);
+    D* distances = quantizedScratchRow<D>(cache.numRows);
+    quantizedKernels<T>().addSquaredColumn(&cache.squaredDistances[i * cache.numRows], column, static_cast<D>(column[i]), distances, cache.numRows);
+    if (!vote.isOneNearest()) return predictByVote(distances, cache.numRows, i, data.labels, vote) == data.labels[i];
+    return predictFromDistances<T>(distances, cache.numRows, i, data.labels) == data.labels[i];
+}
+
+template <typename T>
+double evaluateFeatureAddition(const QuantizedDistanceCache<T>& cache, const QuantizedMatrix<T>& data, int feature, ThreadPool& pool, StepBound* bound = nullptr,
+                               const NeighborVote& vote = NeighborVote()) {
+    return boundedLeaveOneOutAccuracy(pool, cache.numRows, [&](size_t i) {
+        return additionPredictsCorrectly(cache, data, feature, i, vote);
+    }, bound);
+}
+
+// Integer sums are exact, so the subtracted distances are the true distances. Float subtraction leaves
+// rounding noise that breaks exact ties (titanic is full of duplicate rows), so for float, rows near the
+// best are re-summed over the remaining columns in committed order, as the double cache does.
+template <typename T>
+double evaluateFeatureRemoval(const QuantizedDistanceCache<T>& cache, const QuantizedMatrix<T>& data, int feature, ThreadPool& pool, StepBound* bound = nullptr,
+                              const NeighborVote& vote = NeighborVote()) {
+    using D = typename QuantizedTraits<T>::Distance;
+    const T* column = data.column(feature - 1);
+    const QuantizedKernels<T>& kernels = quantizedKernels<T>();
+    vector<const T*> remainingColumns; // Columns of the reduced subset, in committed order
+    for (int committed : cache.features) {
+        if (committed != feature) remainingColumns.push_back(data.column(committed - 1));
+    }
+
+    return boundedLeaveOneOutAccuracy(pool, cache.numRows, [&](size_t i) {
+        D* distances = quantizedScratchRow<D>(cache.numRows);
+        kernels.subtractSquaredColumn(&cache.squaredDistances[i * cache.numRows], column, static_cast<D>(column[i]), distances, cache.numRows);
+        if constexpr (is_integral<D>::value) {
+            if (!vote.isOneNearest()) return predictByVote(distances, cache.numRows, i, data.labels, vote) == data.labels[i];
+            return predictFromDistances<T>(distances, cache.numRows, i, data.labels) == data.labels[i];
+        } else {
+            if (!vote.isOneNearest()) {
+                D tolerance = QuantizedTraits<T>::tieTolerancePerColumn * static_cast<D>(cache.features.size());
+                int predictedLabel = predictByVoteRechecked(distances, cache.numRows, i, data.labels, vote, tolerance, [&](size_t j) {
+                    D distance = 0;
+                    for (const T* remaining : remainingColumns) {
+                        D diff = remaining[i] - remaining[j];
+                        distance += diff * diff;
+                    }
+                    return distance;
+                });
+                return predictedLabel == data.labels[i];
+            }
+            distances[i] = numeric_limits<D>::max(); // Leave out the test instance
+            D approximateMin = distances[kernels.argmin(distances, cache.numRows)];
+            D bound = approximateMin + QuantizedTraits<T>::tieTolerancePerColumn * static_cast<D>(cache.features.size());
+
+            D minDistance = numeric_limits<D>::max();
+            int predictedLabel = -1;
+            for (size_t j = 0; j < cache.numRows; ++j) {
+                if (j == i || distances[j] > bound) continue;
+                D distance = 0;
+                for (const T* remaining : remainingColumns) {
+                    D diff = remaining[i] - remaining[j];
+                    distance += diff * diff;
+                }
+                if (distance < minDistance) {
+                    minDistance = distance;
+                    predictedLabel = data.labels[j];
+                }
+            }
+            return predictedLabel == data.labels[i];
+        }
+    }, bound);
+}
+
+template <typename T>
+void updateCachedRow(QuantizedDistanceCache<T>& cache, const QuantizedMatrix<T>& data, int feature, size_t i, bool add) {
+    using D = typename QuantizedTraits<T>::Distance;
+    const T* column = data.column(feature - 1);
+    D* row = &cache.squaredDistances[i * cache.numRows];
+    if (add) quantizedKernels<T>().addSquaredColumn(row, column, static_cast<D>(column[i]), row, cache.numRows);
+    else quantizedKernels<T>().subtractSquaredColumn(row, column, static_cast<D>(column[i]), row, cache.numRows);
+}
+
+// Whether held-out row i is classified correctly by exactly the committed subset. Integer sums are exact
+// whatever additions and subtractions produced them; float rows near the best are re-summed over `columns`.
+template <typename T>
+bool cachedSubsetPredictsCorrectly(const QuantizedDistanceCache<T>& cache, const QuantizedMatrix<T>& data, const vector<const T*>& columns, size_t i,
+                                   const NeighborVote& vote) {
+    using D = typename QuantizedTraits<T>::Distance;
+    const QuantizedKernels<T>& kernels = quantizedKernels<T>();
+    const D* row = &cache.squaredDistances[i * cache.numRows];
+    size_t numRows = cache.numRows;
+    D tolerance = 0;
+    if constexpr (is_floating_point<D>::value) tolerance = QuantizedTraits<T>::tieTolerancePerColumn * static_cast<D>(columns.size());
+    auto exactDistance = [&](size_t j) {
+        D distance = 0;
+        for (const T* column : columns) {
+            D diff = static_cast<D>(column[i]) - static_cast<D>(column[j]);
+            distance += diff * diff;
+        }
+        return distance;
+    };
+    if (!vote.isOneNearest()) {
+        if constexpr (is_integral<D>::value) return predictByVote(row, numRows, i, data.labels, vote) == data.labels[i];
+        return predictByVoteRechecked(row, numRows, i, data.labels, vote, tolerance, exactDistance) == data.labels[i];
+    }
+
+    // Nearest row on either side of the held-out row, so the shared row is never written; the left one wins ties
+    size_t nearest = i;
+    if (i > 0) nearest = kernels.argmin(row, i);
+    if (i + 1 < numRows) {
+        size_t right = i + 1 + kernels.argmin(row + i + 1, numRows - i - 1);
+        if (nearest == i || row[right] < row[nearest]) nearest = right;
+    }
+    if (nearest == i) return data.labels[i] == -1; // A single row has no neighbor
+    if constexpr (is_integral<D>::value) {
+        return data.labels[nearest] == data.labels[i];
+    } else {
+        D bound = row[nearest] + tolerance;
+        D minDistance = numeric_limits<D>::max();
+        int predictedLabel = -1;
+        for (size_t j = 0; j < numRows; ++j) {
+            if (j == i || row[j] > bound) continue;
+            D distance = exactDistance(j);
+            if (distance < minDistance) {
+                minDistance = distance;
+                predictedLabel = data.labels[j];
+            }
+        }
+        return predictedLabel == data.labels[i];
+    }
+}
+
+// Leave-one-out accuracy of the 1-based `featureSubset`, summing its columns for one held-out row at a time
+template <typename T>
+double quantizedLeaveOneOut(const QuantizedMatrix<T>& data, const vector<int>& featureSubset, ThreadPool& pool) {
+    using D = typename QuantizedTraits<T>::Distance;
+    const QuantizedKernels<T>& kernels = quantizedKernels<T>();
+    TraceScope trace("quantizedLeaveOneOut", "loo");
+    countEvent(Counter::NeighborQueries, data.numRows);
+    countEvent(Counter::DistanceEvaluations, static_cast<uint64_t>(data.numRows) * (data.numRows - 1));
+
+    size_t correctPredictions = pool.parallelCount(data.numRows, [&](size_t i) {
+        D* distances = quantizedScratchRow<D>(data.numRows);
+        fill(distances, distances + data.numRows, D());
+        for (int feature : featureSubset) {
+            const T* column = data.column(feature - 1);
+            kernels.addSquaredColumn(distances, column, static_cast<D>(column[i]), distances, data.numRows);
+        }
+        return predictFromDistances<T>(distances, data.numRows, i, data.labels) == data.labels[i];
+    }, LOO_ROWS_PER_TASK);
+
+    return static_cast<double>(correctPredictions) / data.numRows * 100.0;
+}
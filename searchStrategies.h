@@ -0,0 +1,535 @@
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <unordered_set>
+#include <chrono>
+#include <cstdint>
+#include <atomic>
+#include <type_traits>
+
+#include "featureMatrix.h"
+#include "distanceCache.h"
+#include "quantizedFeatures.h"
+#include "subsetMemo.h"
+#include "featureSearch.h"
+#include "instrumentation.h"
+
+using namespace std;
+
+// Search strategies beyond the greedy ones in featureSearch.h, and the table every front end picks
+// strategies from. These strategies move through subset space with the same incremental distance caches
+// as the greedy searches: adding or removing a feature only touches that feature's column.
+
+// Sequential Floating Forward Selection: after every forward step, keep taking out the committed feature whose
+// removal gives the best subset of the smaller size, as long as that beats every subset of that size seen so
+// far. Backtracking lets it undo an early greedy choice that later additions made redundant. The result is the
+// best subset of any size; ties go to the smaller subset.
+template <typename Dataset>
+SearchResult floatingForwardSelection(const Dataset& data, int totalFeatures, const SearchSettings& settings) {
+    ThreadPool& pool = *settings.pool;
+    TraceScope trace("floatingForwardSelection", "search");
+    auto searchStart = chrono::steady_clock::now();
+    vector<SearchStep> steps;
+
+    double emptyAccuracy = memoizedAccuracy(settings.memo, {}, [&] { return leaveOneOutValidation(data, {}, settings); });
+    cout << "Running nearest neighbor with no features (default rate), using \"leave-one-out\" evaluation, I get an accuracy of "
+         << fixed << setprecision(1) << emptyAccuracy << "%\n";
+    cout << "Beginning search.\n";
+
+    vector<int> selectedFeatures;
+    vector<double> bestBySize(totalFeatures + 1, -1.0); // Best accuracy seen for each subset size
+    bestBySize[0] = emptyAccuracy;
+    vector<int> bestFeatures;
+    double bestAccuracy = emptyAccuracy;
+
+    bool useCache = distanceCachesFit(data, 1, "Floating forward selection", settings);
+    typename DistanceCacheFor<Dataset>::type cache; // Squared distances over selectedFeatures, updated one column per move
+    if (useCache) buildDistanceCache(cache, data, selectedFeatures);
+
+    // Records a committed move and the best subset of any size
+    auto commit = [&](double accuracy) {
+        size_t size = selectedFeatures.size();
+        bestBySize[size] = max(bestBySize[size], accuracy);
+        if (accuracy > bestAccuracy) {
+            bestAccuracy = accuracy;
+            bestFeatures = selectedFeatures;
+        }
+        steps.push_back({selectedFeatures, accuracy, millisecondsSince(searchStart)});
+        cout << "Feature set ";
+        printFeatureSet(selectedFeatures);
+        cout << " was best, accuracy is " << fixed << setprecision(1) << accuracy << "%\n";
+    };
+
+    int step = 0;
+    while (static_cast<int>(selectedFeatures.size()) < totalFeatures) {
+        StepProfiler stepProfile("floating", ++step);
+
+        // Forward move: the best single addition
+        vector<int> additions;
+        for (int feature = 1; feature <= totalFeatures; ++feature) {
+            if (!isFeatureSelected(selectedFeatures, feature)) additions.push_back(feature);
+        }
+        vector<double> accuracies(additions.size());
+        StepBound bound;
+        StepBound* stepBound = settings.bounded ? &bound : nullptr;
+        pool.parallelFor(additions.size(), [&](size_t c) {
+            vector<int> subset = selectedFeatures;
+            subset.push_back(additions[c]);
+            accuracies[c] = scoreCandidate(settings, bound, data.numRows, subset, [&] {
+                return useCache ? evaluateFeatureAddition(cache, data, additions[c], pool, stepBound, settings.vote) : leaveOneOutValidation(data, subset, settings);
+            });
+        });
+
+        int bestAddition = -1;
+        double additionAccuracy = 0.0;
+        for (size_t c = 0; c < additions.size(); ++c) {
+            vector<int> subset = selectedFeatures;
+            subset.push_back(additions[c]);
+            cout << "Using feature(s) ";
+            printFeatureSet(subset);
+            printCandidateAccuracy(accuracies[c]);
+            if (accuracies[c] > additionAccuracy) { // Strict comparison keeps the lowest feature on ties
+                additionAccuracy = accuracies[c];
+                bestAddition = additions[c];
+            }
+        }
+        printSkippedPredictions(bound, settings);
+        if (bestAddition == -1) break;
+        selectedFeatures.push_back(bestAddition);
+        if (useCache) addFeatureToCache(cache, data, bestAddition);
+        commit(additionAccuracy);
+
+        // Conditional backward moves: never the feature just added, and only while a size's record improves
+        while (selectedFeatures.size() > 2) {
+            vector<double> removals(selectedFeatures.size() - 1);
+            StepBound removalBound;
+            StepBound* removalStepBound = settings.bounded ? &removalBound : nullptr;
+            pool.parallelFor(removals.size(), [&](size_t r) {
+                vector<int> subset = selectedFeatures;
+                subset.erase(subset.begin() + r);
+                removals[r] = scoreCandidate(settings, removalBound, data.numRows, subset, [&] {
+                    return useCache ? evaluateFeatureRemoval(cache, data, selectedFeatures[r], pool, removalStepBound, settings.vote) : leaveOneOutValidation(data, subset, settings);
+                });
+            });
+
+            int worstFeature = -1;
+            double removalAccuracy = 0.0;
+            for (size_t r = 0; r < removals.size(); ++r) {
+                if (removals[r] > removalAccuracy) {
+                    removalAccuracy = removals[r];
+                    worstFeature = selectedFeatures[r];
+                }
+            }
+            if (worstFeature == -1 || removalAccuracy <= bestBySize[selectedFeatures.size() - 1]) break;
+
+            cout << "Removing feature " << worstFeature << " beats the best " << selectedFeatures.size() - 1 << "-feature subset so far\n";
+            selectedFeatures.erase(remove(selectedFeatures.begin(), selectedFeatures.end(), worstFeature), selectedFeatures.end());
+            if (useCache) removeFeatureFromCache(cache, data, worstFeature);
+            commit(removalAccuracy);
+        }
+    }
+
+    cout << "Finished search!! The best feature subset is ";
+    printFeatureSet(bestFeatures);
+    cout << ", which has an accuracy of " << fixed << setprecision(1) << bestAccuracy << "%\n";
+    return {bestFeatures, bestAccuracy, steps};
+}
+
+// One beam member: a subset and the distance cache over it
+template <typename Dataset>
+struct BeamEntry {
+    vector<int> features;
+    double accuracy = 0.0;
+    typename DistanceCacheFor<Dataset>::type cache;
+};
+
+// A candidate expansion: beam member `parent` plus `feature`
+struct BeamExpansion {
+    size_t parent;
+    int feature;
+};
+
+// Leave-one-out accuracy of every expansion in one batched pass over the held-out rows. Each task takes a
+// chunk of rows and, for each row, scores every expansion of every beam member while that member's cached
+// distance row is still in cache, instead of streaming all n^2 cached distances once per expansion.
+template <typename Dataset>
+vector<double> evaluateBeamExpansions(const vector<BeamEntry<Dataset>>& beam, const Dataset& data, const vector<BeamExpansion>& expansions,
+                                      const SearchSettings& settings) {
+    TraceScope trace("evaluateBeamExpansions", "search");
+    size_t numRows = data.numRows;
+    size_t numChunks = (numRows + LOO_ROWS_PER_TASK - 1) / LOO_ROWS_PER_TASK;
+    vector<vector<size_t>> chunkCorrect(numChunks, vector<size_t>(expansions.size(), 0)); // Correct predictions per task and expansion
+
+    settings.pool->parallelForRange(numRows, LOO_ROWS_PER_TASK, [&](size_t begin, size_t end) {
+        vector<size_t>& correct = chunkCorrect[begin / LOO_ROWS_PER_TASK];
+        for (size_t i = begin; i < end; ++i) {
+            for (size_t e = 0; e < expansions.size(); ++e) {
+                const BeamExpansion& expansion = expansions[e];
+                correct[e] += additionPredictsCorrectly(beam[expansion.parent].cache, data, expansion.feature, i, settings.vote);
+            }
+        }
+    });
+    countEvent(Counter::NeighborQueries, static_cast<uint64_t>(expansions.size()) * numRows);
+    countEvent(Counter::DistanceEvaluations, static_cast<uint64_t>(expansions.size()) * numRows * numRows);
+
+    vector<double> accuracies(expansions.size());
+    for (size_t e = 0; e < expansions.size(); ++e) {
+        size_t correctPredictions = 0;
+        for (const auto& counts : chunkCorrect) correctPredictions += counts[e];
+        accuracies[e] = static_cast<double>(correctPredictions) / numRows * 100.0;
+    }
+    return accuracies;
+}
+
+// Beam search: every level expands each of the settings.beamWidth best subsets by every feature it lacks and
+// keeps the best beamWidth distinct results. Each member keeps its own distance cache, and all of a level's
+// new subsets are scored in a single batched pass. A level holds up to 2 * beamWidth caches (the beam and the next
+// one); when they do not fit settings.maxCacheBytes, the new subsets are scored with direct leave-one-out. The result is the best subset of any level; ties go to the
+// smaller subset, then to the one generated first (beam order, then feature order).
+template <typename Dataset>
+SearchResult beamSearch(const Dataset& data, int totalFeatures, const SearchSettings& settings) {
+    TraceScope trace("beamSearch", "search");
+    auto searchStart = chrono::steady_clock::now();
+    vector<SearchStep> steps;
+    size_t beamWidth = static_cast<size_t>(max(settings.beamWidth, 1));
+
+    double emptyAccuracy = memoizedAccuracy(settings.memo, {}, [&] { return leaveOneOutValidation(data, {}, settings); });
+    cout << "Running nearest neighbor with no features (default rate), using \"leave-one-out\" evaluation, I get an accuracy of "
+         << fixed << setprecision(1) << emptyAccuracy << "%\n";
+    cout << "Beginning beam search with width " << beamWidth << ".\n";
+
+    bool useCaches = distanceCachesFit(data, 2 * beamWidth, "Beam search", settings);
+    vector<BeamEntry<Dataset>> beam(1);
+    beam[0].accuracy = emptyAccuracy;
+    if (useCaches) buildDistanceCache(beam[0].cache, data, beam[0].features);
+    vector<int> bestFeatures;
+    double bestAccuracy = emptyAccuracy;
+
+    for (int level = 1; level <= totalFeatures; ++level) {
+        StepProfiler stepProfile("beam", level);
+
+        // Distinct expansions of the whole beam; a subset reachable from two members is scored once
+        vector<BeamExpansion> expansions;
+        vector<vector<int>> subsets;
+        unordered_set<FeatureMask, FeatureMaskHash> seen;
+        for (size_t b = 0; b < beam.size(); ++b) {
+            for (int feature = 1; feature <= totalFeatures; ++feature) {
+                if (isFeatureSelected(beam[b].features, feature)) continue;
+                vector<int> subset = beam[b].features;
+                subset.push_back(feature);
+                if (!seen.insert(makeFeatureMask(subset)).second) continue;
+                expansions.push_back({b, feature});
+                subsets.push_back(subset);
+            }
+        }
+        if (expansions.empty()) break;
+
+        // Subsets the memo knows are not rescored; the rest go through one batched pass
+        vector<double> accuracies(expansions.size(), ABANDONED_ACCURACY);
+        vector<BeamExpansion> unknown;
+        vector<size_t> unknownIndex;
+        for (size_t e = 0; e < expansions.size(); ++e) {
+            countEvent(Counter::CandidateEvaluations);
+            if (settings.memo == nullptr || !settings.memo->lookup(subsets[e], accuracies[e])) {
+                unknown.push_back(expansions[e]);
+                unknownIndex.push_back(e);
+            }
+        }
+        vector<double> scored(unknown.size());
+        if (useCaches) {
+            scored = evaluateBeamExpansions(beam, data, unknown, settings);
+        } else {
+            settings.pool->parallelFor(unknown.size(), [&](size_t u) { scored[u] = leaveOneOutValidation(data, subsets[unknownIndex[u]], settings); });
+        }
+        for (size_t u = 0; u < unknown.size(); ++u) {
+            accuracies[unknownIndex[u]] = scored[u];
+            if (settings.memo != nullptr) settings.memo->store(subsets[unknownIndex[u]], scored[u]);
+        }
+
+        for (size_t e = 0; e < expansions.size(); ++e) {
+            cout << "Using feature(s) ";
+            printFeatureSet(subsets[e]);
+            printCandidateAccuracy(accuracies[e]);
+        }
+
+        // Best beamWidth expansions; stable, so ties keep generation order
+        vector<size_t> order(expansions.size());
+        for (size_t e = 0; e < order.size(); ++e) order[e] = e;
+        stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return accuracies[a] > accuracies[b]; });
+        order.resize(min(beamWidth, order.size()));
+
+        vector<BeamEntry<Dataset>> nextBeam(order.size());
+        for (size_t n = 0; n < order.size(); ++n) {
+            const BeamExpansion& expansion = expansions[order[n]];
+            nextBeam[n].features = subsets[order[n]];
+            nextBeam[n].accuracy = accuracies[order[n]];
+            if (useCaches) {
+                nextBeam[n].cache = beam[expansion.parent].cache;
+                addFeatureToCache(nextBeam[n].cache, data, expansion.feature);
+            }
+        }
+        beam.swap(nextBeam);
+
+        if (beam[0].accuracy > bestAccuracy) {
+            bestAccuracy = beam[0].accuracy;
+            bestFeatures = beam[0].features;
+        }
+        steps.push_back({beam[0].features, beam[0].accuracy, millisecondsSince(searchStart)});
+        cout << "Beam:";
+        for (const auto& entry : beam) {
+            cout << " ";
+            printFeatureSet(entry.features);
+            cout << " " << fixed << setprecision(1) << entry.accuracy << "%";
+        }
+        cout << "\n";
+        cout << "Feature set ";
+        printFeatureSet(beam[0].features);
+        cout << " was best, accuracy is " << fixed << setprecision(1) << beam[0].accuracy << "%\n";
+    }
+
+    cout << "Finished search!! The best feature subset is ";
+    printFeatureSet(bestFeatures);
+    cout << ", which has an accuracy of " << fixed << setprecision(1) << bestAccuracy << "%\n";
+    return {bestFeatures, bestAccuracy, steps};
+}
+
+// Widest dataset exhaustive search accepts; 2^30 subsets is already far more than it can score in a session
+const int EXHAUSTIVE_MAX_FEATURES = 30;
+
+// Gray-code steps between rebuilds of a double cache, whose rounding drift then stays far below CACHE_TIE_TOLERANCE
+const uint64_t EXHAUSTIVE_REBUILD_INTERVAL = 1024;
+
+// Gray-code ranges per pool thread, so a thread that finishes early picks up another range
+const size_t EXHAUSTIVE_RANGES_PER_THREAD = 4;
+
+// One subset exhaustive search scored: bit f - 1 of `mask` is feature f
+struct RankedSubset {
+    uint64_t mask = 0;
+    size_t correct = 0; // Correct leave-one-out predictions
+};
+
+// Ranking order: more correct predictions, then fewer features, then the lower mask
+inline bool ranksAbove(const RankedSubset& a, const RankedSubset& b) {
+    if (a.correct != b.correct) return a.correct > b.correct;
+    int sizeA = __builtin_popcountll(a.mask), sizeB = __builtin_popcountll(b.mask);
+    if (sizeA != sizeB) return sizeA < sizeB;
+    return a.mask < b.mask;
+}
+
+// Keeps `ranking` the best `limit` subsets offered so far, best first
+inline void offerRankedSubset(vector<RankedSubset>& ranking, size_t limit, const RankedSubset& subset) {
+    if (ranking.size() == limit && !ranksAbove(subset, ranking.back())) return;
+    ranking.insert(upper_bound(ranking.begin(), ranking.end(), subset, ranksAbove), subset);
+    if (ranking.size() > limit) ranking.pop_back();
+}
+
+// 1-based features of a subset mask, ascending
+inline vector<int> maskFeatures(uint64_t mask) {
+    vector<int> features;
+    for (int feature = 1; mask != 0; ++feature, mask >>= 1) {
+        if (mask & 1) features.push_back(feature);
+    }
+    return features;
+}
+
+// Gray-code steps a walk takes before summing its cache from scratch: never for exact integer sums; float
+// drifts fastest, so it is rebuilt as often as removeFeatureFromCache rebuilds (half of all steps are removals)
+template <typename D>
+uint64_t grayRebuildInterval() {
+    if (is_integral<D>::value) return UINT64_MAX;
+    if (is_same<D, float>::value) return 2 * CACHE_REBUILD_INTERVAL;
+    return EXHAUSTIVE_REBUILD_INTERVAL;
+}
+
+// Exhaustive search: scores all 2^n subsets and ranks the best settings.topSubsets of them. Subsets are walked in
+// Gray-code order, where consecutive subsets differ by one feature, so each subset costs one column added to or
+// subtracted from the distance cache plus one scan of it, whatever its size. The code range is split into
+// disjoint chunks walked in parallel by workers that each keep one n x n cache, with no more workers than
+// settings.maxCacheBytes has caches for; rows near a tie are re-summed exactly, so every accuracy equals a
+// direct leave-one-out of the ascending subset. The memo is not consulted: 2^n entries would swamp it. With
+// bounded scoring, a subset is abandoned once it can no longer enter its chunk's ranking. A dataset too wide to
+// enumerate, or whose one cache exceeds the budget, is reported and gives a failed result.
+template <typename Dataset>
+SearchResult exhaustiveSearch(const Dataset& data, int totalFeatures, const SearchSettings& settings) {
+    using Cache = typename DistanceCacheFor<Dataset>::type;
+    using D = typename decltype(Cache::squaredDistances)::value_type;
+    using Column = decltype(data.column(0));
+    TraceScope trace("exhaustiveSearch", "search");
+    auto searchStart = chrono::steady_clock::now();
+    if (totalFeatures > EXHAUSTIVE_MAX_FEATURES) {
+        cerr << "Error: Exhaustive search supports at most " << EXHAUSTIVE_MAX_FEATURES << " features, the dataset has " << totalFeatures << endl;
+        SearchResult failed;
+        failed.failed = true;
+        return failed;
+    }
+
+    ThreadPool& pool = *settings.pool;
+    size_t numRows = data.numRows;
+    size_t limit = max<size_t>(settings.topSubsets, 1);
+    uint64_t numSubsets = uint64_t(1) << totalFeatures;
+    size_t numRanges = static_cast<size_t>(min<uint64_t>(numSubsets, pool.size() * EXHAUSTIVE_RANGES_PER_THREAD));
+    double cacheBytes = distanceCacheBytes(data);
+    size_t cachesFit = static_cast<size_t>(min(settings.maxCacheBytes / max(cacheBytes, 1.0), 1e9));
+    if (cachesFit == 0) {
+        cerr << "Error: Exhaustive search needs a " << fixed << setprecision(0) << cacheBytes / (1 << 20) << " MB distance cache, over the "
+             << settings.maxCacheBytes / (1 << 20) << " MB limit (see --max-cache-mb)" << endl;
+        SearchResult failed;
+        failed.failed = true;
+        return failed;
+    }
+    size_t workers = min(numRanges, min(pool.size(), cachesFit)); // Ranges walked at once, each holding a cache
+    if (workers < min(numRanges, pool.size())) {
+        cerr << "Note: Exhaustive search walks its ranges " << workers << " at a time so its distance caches fit the "
+             << fixed << setprecision(0) << settings.maxCacheBytes / (1 << 20) << " MB limit (see --max-cache-mb)" << endl;
+    }
+    cout << "Beginning exhaustive search over all " << numSubsets << " feature subsets in Gray-code order ("
+         << numRanges << " ranges).\n";
+
+    vector<vector<RankedSubset>> rankings(numRanges); // Top subsets of each range
+    StepBound bound; // Only its prediction counters are used
+    atomic<size_t> nextRange{0};
+    pool.parallelFor(workers, [&](size_t) {
+        // One cache per worker, reused for every range it takes
+        Cache cache;
+        vector<Column> columns; // The subset's columns in ascending feature order, kept in step with `mask`
+        columns.reserve(totalFeatures);
+        for (size_t r; (r = nextRange++) < numRanges;) {
+            uint64_t begin = numSubsets * r / numRanges, end = numSubsets * (r + 1) / numRanges;
+            vector<RankedSubset>& ranking = rankings[r];
+            uint64_t mask = begin ^ (begin >> 1); // Gray code of `begin`
+            uint64_t stepsSinceRebuild = 0;
+            columns.clear();
+            uint64_t predicted = 0;
+
+            for (uint64_t code = begin; code < end; ++code) {
+                bool rebuild = code == begin;
+                int feature = 0;
+                bool adding = false;
+                if (!rebuild) {
+                    uint64_t flip = code & (~code + 1); // Bit that changes from the Gray code of code - 1 to that of code
+                    feature = __builtin_ctzll(flip) + 1;
+                    mask ^= flip;
+                    adding = (mask & flip) != 0;
+                    if (++stepsSinceRebuild >= grayRebuildInterval<D>()) {
+                        rebuild = true;
+                        stepsSinceRebuild = 0;
+                    }
+                }
+                if (rebuild) buildDistanceCache(cache, data, maskFeatures(mask));
+                if (code == begin) {
+                    for (int selected : cache.features) columns.push_back(data.column(selected - 1));
+                } else {
+                    auto position = columns.begin() + __builtin_popcountll(mask & ((uint64_t(1) << (feature - 1)) - 1));
+                    if (adding) columns.insert(position, data.column(feature - 1));
+                    else columns.erase(position);
+                }
+
+                // Each cached row is updated and, while it is still in cache, scored. With bounded scoring the subset
+                // stops being scored once it cannot reach `needed` correct predictions (ties may still rank above).
+                size_t needed = settings.bounded && ranking.size() == limit ? ranking.back().correct : 0;
+                size_t correct = 0, misses = 0, scored = 0;
+                for (size_t i = 0; i < numRows; ++i) {
+                    if (!rebuild) updateCachedRow(cache, data, feature, i, adding);
+                    if (numRows - misses < needed) continue;
+                    ++scored;
+                    if (cachedSubsetPredictsCorrectly(cache, data, columns, i, settings.vote)) ++correct;
+                    else ++misses;
+                }
+                if (!rebuild && adding) cache.features.push_back(feature);
+                if (!rebuild && !adding) cache.features.erase(find(cache.features.begin(), cache.features.end(), feature));
+                predicted += scored;
+                if (scored == numRows) offerRankedSubset(ranking, limit, {mask, correct});
+            }
+            countEvent(Counter::NeighborQueries, predicted);
+            countEvent(Counter::DistanceEvaluations, predicted * numRows);
+            bound.predictionsMade += predicted;
+            bound.predictionsSkipped += (end - begin) * numRows - predicted;
+        }
+    });
+    countEvent(Counter::CandidateEvaluations, numSubsets);
+
+    vector<RankedSubset> ranking;
+    for (const auto& rangeRanking : rankings) {
+        for (const RankedSubset& subset : rangeRanking) offerRankedSubset(ranking, limit, subset);
+    }
+    printSkippedPredictions(bound, settings);
+
+    vector<SearchStep> steps;
+    double elapsed = millisecondsSince(searchStart);
+    cout << "Top " << ranking.size() << " feature subsets:\n";
+    for (size_t r = 0; r < ranking.size(); ++r) {
+        vector<int> features = maskFeatures(ranking[r].mask);
+        double accuracy = numRows == 0 ? 0.0 : static_cast<double>(ranking[r].correct) / numRows * 100.0;
+        steps.push_back({features, accuracy, elapsed});
+        cout << "  " << r + 1 << ". Feature set ";
+        printFeatureSet(features);
+        cout << " accuracy is " << fixed << setprecision(1) << accuracy << "%\n";
+    }
+
+    cout << "Finished search!! The best feature subset is ";
+    printFeatureSet(steps.front().features);
+    cout << ", which has an accuracy of " << fixed << setprecision(1) << steps.front().accuracy << "%\n";
+    return {steps.front().features, steps.front().accuracy, steps};
+}
+
+// A search the front ends can run: its --algo name, its menu title and the function that runs it
+template <typename Dataset>
+struct SearchStrategy {
+    const char* name;
+    const char* title;
+    SearchResult (*run)(const Dataset& data, int totalFeatures, const SearchSettings& settings);
+};
+
+// Every strategy, in menu order; menu choice N runs entry N - 1. New strategies only need a line here.
+template <typename Dataset>
+const vector<SearchStrategy<Dataset>>& searchStrategies() {
+    static const vector<SearchStrategy<Dataset>> strategies = {
+        {"forward", "Forward Selection", forwardSelection<Dataset>},
+        {"backward", "Backward Elimination", backwardElimination<Dataset>},
+        {"bidir", "Custom Bidirectional Algorithm", bidirectionalSearch<Dataset>},
+        {"sffs", "Sequential Floating Forward Selection", floatingForwardSelection<Dataset>},
+        {"beam", "Beam Search", beamSearch<Dataset>},
+        {"exhaustive", "Exhaustive Search (Gray code)", exhaustiveSearch<Dataset>},
+    };
+    return strategies;
+}
+
+inline size_t numSearchStrategies() {
+    return searchStrategies<FeatureMatrix>().size();
+}
+
+// Menu choice (1-based) of the strategy called `name`, or 0 if there is none ("bidirectional" is accepted too)
+inline int searchChoice(const string& name) {
+    const auto& strategies = searchStrategies<FeatureMatrix>();
+    for (size_t s = 0; s < strategies.size(); ++s) {
+        if (name == strategies[s].name || (name == "bidirectional" && string(strategies[s].name) == "bidir")) return static_cast<int>(s + 1);
+    }
+    return 0;
+}
+
+inline const char* searchName(int choice) {
+    return searchStrategies<FeatureMatrix>()[choice - 1].name;
+}
+
+// Runs menu choice `choice` on `data`; `valid` is cleared for a choice with no strategy
+template <typename Dataset>
+SearchResult runSearch(const Dataset& data, int choice, const SearchSettings& settings, bool& valid) {
+    const auto& strategies = searchStrategies<Dataset>();
+    valid = choice >= 1 && static_cast<size_t>(choice) <= strategies.size();
+    if (!valid) return {};
+    return strategies[choice - 1].run(data, static_cast<int>(data.numFeatures), settings);
+}
+
+// Runs search `choice` on `instances` stored at `precision`
+inline SearchResult runSearchAtPrecision(const FeatureMatrix& instances, FeaturePrecision precision, int choice, const SearchSettings& settings, bool& valid) {
+    switch (precision) {
+    case FeaturePrecision::Float32: return runSearch(quantizeFeatures<float>(instances), choice, settings, valid);
+    case FeaturePrecision::Int16: return runSearch(quantizeFeatures<uint16_t>(instances), choice, settings, valid);
+    case FeaturePrecision::Int8: return runSearch(quantizeFeatures<uint8_t>(instances), choice, settings, valid);
+    default: return runSearch(instances, choice, settings, valid);
+    }
+}
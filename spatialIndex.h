@@ -0,0 +1,275 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "featureMatrix.h"
+
+using namespace std;
+
+// Rows per leaf; leaves are scanned linearly
+const size_t SPATIAL_LEAF_SIZE = 16;
+
+// A subtree is only skipped when its bound beats the best distance by this much, so rounding in the
+// bound can never hide a tie (features are normalized to [0, 1])
+const double SPATIAL_PRUNE_TOLERANCE = 1e-9;
+
+// Row-major copy of a feature subset in the order a tree visits it.
+// Distances are summed in subset order, the same way the brute-force scan sums them,
+// so a tree query returns exactly the neighbor brute force would (lowest row index on ties).
+struct PackedPoints {
+    size_t width = 0;
+    vector<double> values;   // One point after another, in tree order
+    vector<size_t> rowIndex; // Tree order -> dataset row
+    vector<size_t> position; // Dataset row -> tree order
+
+    const double* point(size_t treePosition) const { return &values[treePosition * width]; }
+};
+
+// Identity row order; a tree permutes rowIndex while it is built
+inline PackedPoints startPacking(const FeatureMatrix& data, const vector<int>& features) {
+    PackedPoints packed;
+    packed.width = features.size();
+    packed.rowIndex.resize(data.numRows);
+    for (size_t row = 0; row < data.numRows; ++row) packed.rowIndex[row] = row;
+    return packed;
+}
+
+// Copies the 1-based `features` of `data` row-major in the final rowIndex order
+inline void finishPacking(PackedPoints& packed, const FeatureMatrix& data, const vector<int>& features) {
+    packed.values.resize(data.numRows * packed.width);
+    packed.position.resize(data.numRows);
+    for (size_t p = 0; p < data.numRows; ++p) {
+        size_t row = packed.rowIndex[p];
+        packed.position[row] = p;
+        for (size_t k = 0; k < packed.width; ++k) packed.values[p * packed.width + k] = data.at(row, features[k] - 1);
+    }
+}
+
+// Exact squared distance between two packed points, summed in subset order (no fused multiply-add,
+// matching the distance kernels)
+__attribute__((optimize("fp-contract=off")))
+inline double packedSquaredDistance(const double* x, const double* y, size_t width) {
+    double distance = 0.0;
+    for (size_t k = 0; k < width; ++k) {
+        double diff = x[k] - y[k];
+        distance += diff * diff;
+    }
+    return distance;
+}
+
+// Best neighbor found so far during a tree query
+struct NeighborCandidate {
+    size_t row;
+    double squaredDistance = numeric_limits<double>::infinity();
+
+    // Keeps the closer row; equal distances go to the lower dataset row, matching the brute-force scan
+    void offer(size_t candidateRow, double distance) {
+        if (distance < squaredDistance || (distance == squaredDistance && candidateRow < row)) {
+            squaredDistance = distance;
+            row = candidateRow;
+        }
+    }
+};
+
+// Scans packed points [begin, end) against `query`, skipping the held-out row
+inline void scanLeaf(const PackedPoints& packed, size_t begin, size_t end, const double* query, size_t excludedRow, NeighborCandidate& best) {
+    countEvent(Counter::DistanceEvaluations, end - begin);
+    for (size_t p = begin; p < end; ++p) {
+        size_t row = packed.rowIndex[p];
+        if (row == excludedRow) continue;
+        best.offer(row, packedSquaredDistance(query, packed.point(p), packed.width));
+    }
+}
+
+// ---------------- KD-tree (low subset widths) ----------------
+
+struct KdNode {
+    size_t begin, end;     // Range of packed points under this node
+    int splitFeature = -1; // Position within the subset, -1 for a leaf
+    double splitValue = 0.0;
+    int left = -1, right = -1;
+};
+
+struct KdTree {
+    PackedPoints packed;
+    vector<KdNode> nodes;
+};
+
+// Splits [begin, end) at the median of its widest-spread feature until the leaves are small
+inline int buildKdNode(KdTree& tree, const FeatureMatrix& data, const vector<int>& features, size_t begin, size_t end) {
+    int index = static_cast<int>(tree.nodes.size());
+    tree.nodes.push_back({begin, end});
+    if (end - begin <= SPATIAL_LEAF_SIZE) return index;
+
+    vector<size_t>& rows = tree.packed.rowIndex;
+    int bestFeature = -1;
+    double bestSpread = 0.0;
+    for (size_t k = 0; k < features.size(); ++k) {
+        const double* column = data.column(features[k] - 1);
+        double low = numeric_limits<double>::max(), high = numeric_limits<double>::lowest();
+        for (size_t p = begin; p < end; ++p) {
+            low = min(low, column[rows[p]]);
+            high = max(high, column[rows[p]]);
+        }
+        if (high - low > bestSpread) {
+            bestSpread = high - low;
+            bestFeature = static_cast<int>(k);
+        }
+    }
+    if (bestFeature < 0) return index; // Every point identical: keep as one leaf
+
+    const double* column = data.column(features[bestFeature] - 1);
+    size_t middle = begin + (end - begin) / 2;
+    nth_element(rows.begin() + begin, rows.begin() + middle, rows.begin() + end,
+                [column](size_t a, size_t b) { return column[a] < column[b]; });
+
+    double splitValue = column[rows[middle]];
+    int left = buildKdNode(tree, data, features, begin, middle);
+    int right = buildKdNode(tree, data, features, middle, end);
+    tree.nodes[index].splitFeature = bestFeature;
+    tree.nodes[index].splitValue = splitValue;
+    tree.nodes[index].left = left;
+    tree.nodes[index].right = right;
+    return index;
+}
+
+// KD-tree over the 1-based `features` of `data`
+inline KdTree buildKdTree(const FeatureMatrix& data, const vector<int>& features) {
+    KdTree tree;
+    tree.packed = startPacking(data, features);
+    if (data.numRows > 0) buildKdNode(tree, data, features, 0, data.numRows);
+    finishPacking(tree.packed, data, features);
+    return tree;
+}
+
+// Depth-first KD-tree search from node `index`
+inline void searchKdNode(const KdTree& tree, int index, const double* query, size_t excludedRow, NeighborCandidate& best) {
+    const KdNode& node = tree.nodes[index];
+    if (node.splitFeature < 0) {
+        scanLeaf(tree.packed, node.begin, node.end, query, excludedRow, best);
+        return;
+    }
+
+    // Nearer side first; the far side only if the splitting plane is within the best distance
+    double offset = query[node.splitFeature] - node.splitValue;
+    int nearSide = offset < 0 ? node.left : node.right;
+    int farSide = offset < 0 ? node.right : node.left;
+    searchKdNode(tree, nearSide, query, excludedRow, best);
+    if (offset * offset <= best.squaredDistance + SPATIAL_PRUNE_TOLERANCE) {
+        searchKdNode(tree, farSide, query, excludedRow, best);
+    }
+}
+
+// Nearest neighbor of dataset row `testIndex`, excluding the row itself
+inline size_t findNearestKdTree(const KdTree& tree, size_t testIndex, double& nearestSquared) {
+    NeighborCandidate best{testIndex};
+    if (!tree.nodes.empty()) {
+        searchKdNode(tree, 0, tree.packed.point(tree.packed.position[testIndex]), testIndex, best);
+    }
+    nearestSquared = best.squaredDistance;
+    return best.row;
+}
+
+// ---------------- Vantage-point tree (wider subsets) ----------------
+
+struct VpNode {
+    size_t begin, end;       // Range of packed points under this node (vantage point first)
+    double radius = 0.0;     // Median distance from the vantage point
+    int inside = -1, outside = -1; // Children; both -1 for a leaf
+};
+
+struct VpTree {
+    PackedPoints packed;
+    vector<VpNode> nodes;
+};
+
+// Picks a vantage point for [begin, end) and splits the rest at the median distance from it.
+// `distances` is scratch space indexed by dataset row; `state` drives the vantage point choice.
+inline int buildVpNode(VpTree& tree, const FeatureMatrix& data, const vector<int>& features, size_t begin, size_t end,
+                       vector<double>& distances, uint64_t& state) {
+    int index = static_cast<int>(tree.nodes.size());
+    tree.nodes.push_back({begin, end});
+    if (end - begin <= SPATIAL_LEAF_SIZE) return index;
+
+    vector<size_t>& rows = tree.packed.rowIndex;
+    size_t width = features.size();
+    auto rowDistance = [&](size_t a, size_t b) {
+        double distance = 0.0;
+        for (size_t k = 0; k < width; ++k) {
+            double diff = data.at(a, features[k] - 1) - data.at(b, features[k] - 1);
+            distance += diff * diff;
+        }
+        return sqrt(distance);
+    };
+
+    // Deterministic pseudo-random vantage point, moved to the front of the range
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    swap(rows[begin], rows[begin + (state >> 33) % (end - begin)]);
+    size_t vantage = rows[begin];
+
+    size_t middle = begin + 1 + (end - begin - 1) / 2;
+    for (size_t p = begin + 1; p < end; ++p) distances[rows[p]] = rowDistance(vantage, rows[p]);
+    nth_element(rows.begin() + begin + 1, rows.begin() + middle, rows.begin() + end,
+                [&distances](size_t a, size_t b) { return distances[a] < distances[b]; });
+
+    double radius = distances[rows[middle]];
+    int inside = buildVpNode(tree, data, features, begin + 1, middle, distances, state);
+    int outside = buildVpNode(tree, data, features, middle, end, distances, state);
+    tree.nodes[index].radius = radius;
+    tree.nodes[index].inside = inside;
+    tree.nodes[index].outside = outside;
+    return index;
+}
+
+// Vantage-point tree over the 1-based `features` of `data`
+inline VpTree buildVpTree(const FeatureMatrix& data, const vector<int>& features) {
+    VpTree tree;
+    tree.packed = startPacking(data, features);
+    vector<double> distances(data.numRows);
+    uint64_t state = 42;
+    if (data.numRows > 0) buildVpNode(tree, data, features, 0, data.numRows, distances, state);
+    finishPacking(tree.packed, data, features);
+    return tree;
+}
+
+// Depth-first vantage-point tree search from node `index`
+inline void searchVpNode(const VpTree& tree, int index, const double* query, size_t excludedRow, NeighborCandidate& best) {
+    const VpNode& node = tree.nodes[index];
+    if (node.inside < 0) {
+        scanLeaf(tree.packed, node.begin, node.end, query, excludedRow, best);
+        return;
+    }
+
+    // The vantage point itself is a candidate
+    size_t vantageRow = tree.packed.rowIndex[node.begin];
+    double vantageSquared = packedSquaredDistance(query, tree.packed.point(node.begin), tree.packed.width);
+    countEvent(Counter::DistanceEvaluations);
+    if (vantageRow != excludedRow) best.offer(vantageRow, vantageSquared);
+    double toVantage = sqrt(vantageSquared);
+
+    // Triangle inequality: a shell can only hold a closer point if it reaches within the best radius
+    bool insideFirst = toVantage <= node.radius;
+    for (int pass = 0; pass < 2; ++pass) {
+        bool inside = (pass == 0) == insideFirst;
+        double reach = sqrt(best.squaredDistance) + SPATIAL_PRUNE_TOLERANCE;
+        if (inside && toVantage - node.radius <= reach) {
+            searchVpNode(tree, node.inside, query, excludedRow, best);
+        } else if (!inside && node.radius - toVantage <= reach) {
+            searchVpNode(tree, node.outside, query, excludedRow, best);
+        }
+    }
+}
+
+// Nearest neighbor of dataset row `testIndex`, excluding the row itself
+inline size_t findNearestVpTree(const VpTree& tree, size_t testIndex, double& nearestSquared) {
+    NeighborCandidate best{testIndex};
+    if (!tree.nodes.empty()) {
+        searchVpNode(tree, 0, tree.packed.point(tree.packed.position[testIndex]), testIndex, best);
+    }
+    nearestSquared = best.squaredDistance;
+    return best.row;
+}
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <limits>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <fcntl.h>  // For open
+#include <unistd.h> // For read and close
+
+#include "featureMatrix.h"
+#include "datasetParser.h"
+#include "distanceKernels.h"
+#include "threadPool.h"
+#include "instrumentation.h"
+
+using namespace std;
+
+// Bytes read from the file at a time by streamDataset
+const size_t STREAM_READ_BYTES = 1 << 20;
+
+// Reads `filename` front to back through a fixed-size buffer and calls onRow(row, label, values, numFeatures)
+// for every data line, `values` holding all of its features. Memory stays at STREAM_READ_BYTES plus the longest
+// line whatever the file size. onRow returns false to stop early. The first data line fixes the number of
+// features, and malformed lines are reported like parseDataset reports them. Returns the number of rows seen.
+template <typename OnRow>
+size_t streamDataset(const string& filename, OnRow onRow) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "Error: Unable to open file " << filename << endl;
+        exit(1);
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    vector<char> buffer(STREAM_READ_BYTES);
+    size_t buffered = 0;       // Bytes of buffer holding unparsed input
+    size_t numFeatures = 0;
+    bool widthKnown = false;
+    vector<double> values;
+    size_t row = 0, lineNumber = 0;
+    bool atEnd = false, stopped = false;
+
+    auto fail = [&](const string& error) {
+        cerr << "Error: Line " << lineNumber << " of " << filename << " " << error << endl;
+        exit(1);
+    };
+
+    while (!atEnd && !stopped) {
+        if (buffered == buffer.size()) buffer.resize(buffer.size() * 2); // A line longer than the buffer
+        ssize_t got = read(fd, buffer.data() + buffered, buffer.size() - buffered);
+        if (got < 0) {
+            cerr << "Error: Unable to read file " << filename << endl;
+            exit(1);
+        }
+        atEnd = got == 0;
+        buffered += static_cast<size_t>(got);
+
+        const char* p = buffer.data();
+        const char* end = buffer.data() + buffered;
+        while (p < end && !stopped) {
+            const char* stop = lineEnd(p, end);
+            if (stop == end && !atEnd) break; // Partial line, wait for more input
+            ++lineNumber;
+            const char* next = stop + (stop < end);
+            if (isBlankLine(p, stop)) {
+                p = next;
+                continue;
+            }
+
+            int label;
+            size_t numValues;
+            string error;
+            bool parsed = parseDataLine(p, stop, label, numValues, error, [&](size_t feature, double value) {
+                if (feature >= values.size()) values.resize(feature + 1);
+                values[feature] = value;
+            });
+            if (!parsed) fail(error);
+            if (!widthKnown) {
+                numFeatures = numValues;
+                widthKnown = true;
+            } else if (numValues != numFeatures) {
+                fail("has " + to_string(numValues) + " features, expected " + to_string(numFeatures));
+            }
+            stopped = !onRow(row++, label, values.data(), numFeatures);
+            p = next;
+        }
+
+        size_t consumed = p - buffer.data();
+        memmove(buffer.data(), p, buffered - consumed);
+        buffered -= consumed;
+    }
+    close(fd);
+    return row;
+}
+
+// What the normalization pass learns about a file without keeping its rows
+struct StreamedDatasetInfo {
+    size_t numRows = 0;
+    size_t numFeatures = 0;
+    vector<double> minValues; // Raw range of each column, as normalizeFeatures records it
+    vector<double> maxValues;
+};
+
+// First pass: row count, width and per-column min/max
+inline StreamedDatasetInfo scanDatasetRanges(const string& filename) {
+    TraceScope trace("scanDatasetRanges", "stream");
+    StreamedDatasetInfo info;
+    info.numRows = streamDataset(filename, [&info](size_t row, int, const double* values, size_t numFeatures) {
+        if (row == 0) {
+            info.numFeatures = numFeatures;
+            info.minValues.assign(numFeatures, numeric_limits<double>::max());
+            info.maxValues.assign(numFeatures, numeric_limits<double>::lowest());
+        }
+        for (size_t f = 0; f < numFeatures; ++f) {
+            info.minValues[f] = min(info.minValues[f], values[f]);
+            info.maxValues[f] = max(info.maxValues[f], values[f]);
+        }
+        return true;
+    });
+    return info;
+}
+
+// Rows [firstRow, firstRow + numRows) of the file restricted to a feature subset, normalized, column by column
+struct StreamBlock {
+    size_t firstRow = 0;
+    FeatureMatrix columns; // numRows x subset width, allocated once at the block capacity
+    size_t numRows = 0;
+};
+
+// Per-run figures for a streaming leave-one-out evaluation
+struct StreamingReport {
+    size_t numRows = 0;
+    size_t numFeatures = 0;
+    size_t blockRows = 0;     // Rows per held-out and per training block
+    size_t numBlocks = 0;
+    size_t filePasses = 0;    // Times the file was read (fully or up to a held-out block)
+    size_t blockBytes = 0;    // Memory held by blocks and per-row state, the part the budget bounds
+};
+
+// Rows per block that fit `budgetBytes`: a held-out and a training block of the subset's columns and labels,
+// each held-out row's best distance and label, and one distance row per thread
+inline size_t streamingBlockRows(size_t budgetBytes, size_t width, size_t numThreads) {
+    size_t bytesPerRow = 2 * (width * sizeof(double) + sizeof(int)) + sizeof(double) + sizeof(int) + numThreads * sizeof(double);
+    return max<size_t>(budgetBytes / bytesPerRow, 1);
+}
+
+// Leave-one-out accuracy of the 1-based `features` of a dataset that never has to fit in memory.
+// Pass one finds the column ranges; then for each held-out block every training block is streamed past it and
+// each held-out row keeps its best distance and label so far. Distances are summed column by column in subset
+// order with the same kernels as the in-memory scan, and a training row only replaces the best on a strictly
+// smaller distance, so blocks (read in file order) pick the same lowest-index neighbor and the accuracy is
+// bit-identical to leaveOneOutValidation on the loaded, normalized dataset.
+inline double streamingLeaveOneOut(const string& filename, const vector<int>& features, size_t budgetBytes, ThreadPool& pool,
+                                   StreamingReport* report = nullptr) {
+    TraceScope trace("streamingLeaveOneOut", "stream");
+    StreamedDatasetInfo info = scanDatasetRanges(filename);
+    size_t filePasses = 1;
+    for (int feature : features) {
+        if (feature < 1 || static_cast<size_t>(feature) > info.numFeatures) {
+            cerr << "Error: " << filename << " has only " << info.numFeatures << " features" << endl;
+            exit(1);
+        }
+    }
+    if (report != nullptr) {
+        report->numRows = info.numRows;
+        report->numFeatures = info.numFeatures;
+    }
+    if (info.numRows == 0) return 0.0;
+
+    size_t width = features.size();
+    size_t blockRows = min(streamingBlockRows(budgetBytes, width, pool.size()), info.numRows);
+    const DistanceKernels& kernels = distanceKernels();
+
+    StreamBlock held, training;
+    held.columns = makeFeatureMatrix(blockRows, width);
+    training.columns = makeFeatureMatrix(blockRows, width);
+    vector<double> bestDistance(blockRows);
+    vector<int> bestLabel(blockRows);
+
+    // Copies the subset of one raw row into `block`, normalized
+    auto store = [&](StreamBlock& block, const double* values, int label) {
+        size_t r = block.numRows++;
+        for (size_t k = 0; k < width; ++k) {
+            size_t f = static_cast<size_t>(features[k] - 1);
+            block.columns.at(r, k) = normalizeValue(info.minValues[f], info.maxValues[f], values[f]);
+        }
+        block.columns.labels[r] = label;
+    };
+
+    // Offers every row of `training` to every held-out row
+    auto scanTrainingBlock = [&]() {
+        pool.parallelForRange(held.numRows, LOO_ROWS_PER_TASK, [&](size_t begin, size_t end) {
+            double* distances = scratchRow(training.numRows);
+            for (size_t h = begin; h < end; ++h) {
+                fill(distances, distances + training.numRows, 0.0);
+                for (size_t k = 0; k < width; ++k) {
+                    const double* column = training.columns.column(k);
+                    kernels.addSquaredColumn(distances, column, held.columns.at(h, k), distances, training.numRows);
+                }
+                size_t heldRow = held.firstRow + h;
+                if (heldRow >= training.firstRow && heldRow < training.firstRow + training.numRows) {
+                    excludeRow(distances, heldRow - training.firstRow); // Leave out the test instance
+                }
+                size_t nearest = kernels.argmin(distances, training.numRows);
+                if (distances[nearest] < bestDistance[h]) { // Earlier blocks win ties, like the lowest index does
+                    bestDistance[h] = distances[nearest];
+                    bestLabel[h] = training.columns.labels[nearest];
+                }
+            }
+        });
+        countEvent(Counter::NeighborQueries, held.numRows);
+        countEvent(Counter::DistanceEvaluations, static_cast<uint64_t>(held.numRows) * training.numRows);
+    };
+
+    size_t correctPredictions = 0;
+    size_t numBlocks = 0;
+    for (size_t heldStart = 0; heldStart < info.numRows; heldStart += blockRows, ++numBlocks) {
+        size_t heldEnd = min(heldStart + blockRows, info.numRows);
+        held.firstRow = heldStart;
+        held.numRows = 0;
+        streamDataset(filename, [&](size_t row, int label, const double* values, size_t) {
+            if (row >= heldStart) store(held, values, label);
+            return row + 1 < heldEnd; // Stop reading once the block is complete
+        });
+        fill(bestDistance.begin(), bestDistance.end(), numeric_limits<double>::infinity());
+        fill(bestLabel.begin(), bestLabel.end(), -1);
+
+        training.firstRow = 0;
+        training.numRows = 0;
+        streamDataset(filename, [&](size_t, int label, const double* values, size_t) {
+            store(training, values, label);
+            if (training.numRows == blockRows) {
+                scanTrainingBlock();
+                training.firstRow += training.numRows;
+                training.numRows = 0;
+            }
+            return true;
+        });
+        if (training.numRows > 0) scanTrainingBlock();
+        filePasses += 2;
+
+        for (size_t h = 0; h < held.numRows; ++h) {
+            if (bestLabel[h] == held.columns.labels[h]) ++correctPredictions;
+        }
+    }
+
+    if (report != nullptr) {
+        report->blockRows = blockRows;
+        report->numBlocks = numBlocks;
+        report->filePasses = filePasses;
+        report->blockBytes = 2 * (held.columns.stride * max<size_t>(width, 1) * sizeof(double) + blockRows * sizeof(int))
+                           + blockRows * (sizeof(double) + sizeof(int)) + pool.size() * blockRows * sizeof(double);
+    }
+    return static_cast<double>(correctPredictions) / info.numRows * 100.0;
+}
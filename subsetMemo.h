@@ -0,0 +1,190 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstring>  // For memcmp
+#include <cstdio>   // For rename and remove
+#include <unistd.h> // For getpid
+
+#include "featureMatrix.h"
+#include "boundedScoring.h"
+
+using namespace std;
+
+// Canonical key for a feature subset: bit f-1 is set for every 1-based feature f, so the same set of
+// features maps to the same key whatever order a search assembled it in
+struct FeatureMask {
+    vector<uint64_t> words;
+
+    bool operator==(const FeatureMask& other) const { return words == other.words; }
+};
+
+inline FeatureMask makeFeatureMask(const vector<int>& features) {
+    FeatureMask mask;
+    for (int feature : features) {
+        size_t bit = static_cast<size_t>(feature - 1);
+        if (mask.words.size() <= bit / 64) mask.words.resize(bit / 64 + 1, 0);
+        mask.words[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+    while (!mask.words.empty() && mask.words.back() == 0) mask.words.pop_back(); // Canonical length
+    return mask;
+}
+
+struct FeatureMaskHash {
+    size_t operator()(const FeatureMask& mask) const {
+        uint64_t hash = 14695981039346656037ULL;
+        for (uint64_t word : mask.words) hash = (hash ^ word) * 1099511628211ULL;
+        return static_cast<size_t>(hash);
+    }
+};
+
+// Identifies a dataset's contents (labels and normalized values) for memo files; FNV-1a over the raw bytes
+inline uint64_t datasetContentHash(const FeatureMatrix& data) {
+    uint64_t hash = 14695981039346656037ULL;
+    auto mix = [&hash](const void* bytes, size_t length) {
+        const unsigned char* p = static_cast<const unsigned char*>(bytes);
+        for (size_t i = 0; i < length; ++i) hash = (hash ^ p[i]) * 1099511628211ULL;
+    };
+    mix(&data.numRows, sizeof(data.numRows));
+    mix(&data.numFeatures, sizeof(data.numFeatures));
+    mix(data.labels.data(), data.labels.size() * sizeof(int));
+    for (size_t f = 0; f < data.numFeatures; ++f) mix(data.column(f), data.numRows * sizeof(double));
+    return hash;
+}
+
+const char SUBSET_MEMO_MAGIC[8] = {'K', 'N', 'N', 'M', 'E', 'M', 'O', '1'};
+
+// Leave-one-out accuracy of every feature subset scored so far, shared by all three searches.
+// Lookups and stores may come from any pool thread. A subset being scored by two tasks at once is simply
+// computed twice; both store the same accuracy.
+class SubsetMemo {
+public:
+    // Returns the accuracy of `features`, computing it with `evaluate()` only if it has not been scored yet.
+    // Abandoned scores pass through without being stored.
+    template <typename Evaluate>
+    double evaluate(const vector<int>& features, Evaluate evaluate) {
+        FeatureMask mask = makeFeatureMask(features);
+        {
+            shared_lock<shared_mutex> guard(lock);
+            auto found = accuracies.find(mask);
+            if (found != accuracies.end()) {
+                hitCount.fetch_add(1, memory_order_relaxed);
+                countEvent(Counter::MemoHits);
+                return found->second;
+            }
+        }
+        missCount.fetch_add(1, memory_order_relaxed);
+        double accuracy = evaluate();
+        if (isAbandoned(accuracy)) return accuracy; // Only a lower bound, never reuse it
+        unique_lock<shared_mutex> guard(lock);
+        accuracies.emplace(move(mask), accuracy);
+        return accuracy;
+    }
+
+    // Sets `accuracy` and returns true if `features` was scored already, for callers that score outside evaluate()
+    bool lookup(const vector<int>& features, double& accuracy) {
+        FeatureMask mask = makeFeatureMask(features);
+        shared_lock<shared_mutex> guard(lock);
+        auto found = accuracies.find(mask);
+        if (found == accuracies.end()) return false;
+        hitCount.fetch_add(1, memory_order_relaxed);
+        countEvent(Counter::MemoHits);
+        accuracy = found->second;
+        return true;
+    }
+
+    // Records an accuracy computed outside evaluate(); counts as a miss like evaluate() computing it would
+    void store(const vector<int>& features, double accuracy) {
+        if (isAbandoned(accuracy)) return;
+        missCount.fetch_add(1, memory_order_relaxed);
+        unique_lock<shared_mutex> guard(lock);
+        accuracies.emplace(makeFeatureMask(features), accuracy);
+    }
+
+    size_t hits() const { return hitCount.load(); }
+    size_t misses() const { return missCount.load(); }
+    size_t size() const {
+        shared_lock<shared_mutex> guard(lock);
+        return accuracies.size();
+    }
+
+    // Loads entries saved for the same dataset contents and `variant` (anything else that changes accuracies,
+    // such as the storage precision). A missing, foreign or damaged file leaves the memo as it was.
+    bool load(const string& path, uint64_t datasetHash, uint32_t variant) {
+        ifstream file(path, ios::binary);
+        char magic[8];
+        uint64_t hash = 0, count = 0;
+        uint32_t savedVariant = 0;
+        if (!file.read(magic, sizeof(magic)) || memcmp(magic, SUBSET_MEMO_MAGIC, sizeof(magic)) != 0) return false;
+        file.read(reinterpret_cast<char*>(&hash), sizeof(hash));
+        file.read(reinterpret_cast<char*>(&savedVariant), sizeof(savedVariant));
+        file.read(reinterpret_cast<char*>(&count), sizeof(count));
+        if (!file || hash != datasetHash || savedVariant != variant) return false;
+
+        unordered_map<FeatureMask, double, FeatureMaskHash> loaded;
+        for (uint64_t e = 0; e < count; ++e) {
+            uint32_t numWords = 0;
+            FeatureMask mask;
+            double accuracy;
+            file.read(reinterpret_cast<char*>(&numWords), sizeof(numWords));
+            if (!file || numWords > 1024) return false;
+            mask.words.resize(numWords);
+            file.read(reinterpret_cast<char*>(mask.words.data()), numWords * sizeof(uint64_t));
+            file.read(reinterpret_cast<char*>(&accuracy), sizeof(accuracy));
+            if (!file) return false;
+            loaded.emplace(move(mask), accuracy);
+        }
+
+        unique_lock<shared_mutex> guard(lock);
+        accuracies.insert(loaded.begin(), loaded.end());
+        return true;
+    }
+
+    // Writes every entry under a temporary name and renames it into place; returns false on failure
+    bool save(const string& path, uint64_t datasetHash, uint32_t variant) const {
+        string temporary = path + "." + to_string(getpid());
+        {
+            ofstream file(temporary, ios::binary);
+            if (!file.is_open()) return false;
+            shared_lock<shared_mutex> guard(lock);
+            uint64_t count = accuracies.size();
+            file.write(SUBSET_MEMO_MAGIC, sizeof(SUBSET_MEMO_MAGIC));
+            file.write(reinterpret_cast<const char*>(&datasetHash), sizeof(datasetHash));
+            file.write(reinterpret_cast<const char*>(&variant), sizeof(variant));
+            file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+            for (const auto& entry : accuracies) {
+                uint32_t numWords = static_cast<uint32_t>(entry.first.words.size());
+                file.write(reinterpret_cast<const char*>(&numWords), sizeof(numWords));
+                file.write(reinterpret_cast<const char*>(entry.first.words.data()), numWords * sizeof(uint64_t));
+                file.write(reinterpret_cast<const char*>(&entry.second), sizeof(entry.second));
+            }
+            if (!file) {
+                remove(temporary.c_str());
+                return false;
+            }
+        }
+        if (rename(temporary.c_str(), path.c_str()) != 0) {
+            remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    unordered_map<FeatureMask, double, FeatureMaskHash> accuracies;
+    mutable shared_mutex lock;
+    atomic<size_t> hitCount{0};
+    atomic<size_t> missCount{0};
+};
+
+// Scores `features` through `memo` when there is one, otherwise just calls `evaluate()`
+template <typename Evaluate>
+double memoizedAccuracy(SubsetMemo* memo, const vector<int>& features, Evaluate evaluate) {
+    return memo != nullptr ? memo->evaluate(features, evaluate) : evaluate();
+}
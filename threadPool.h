@@ -0,0 +1,164 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <algorithm>
+
+using namespace std;
+
+// Held-out rows handed to each task when a leave-one-out loop is split across the pool
+const size_t LOO_ROWS_PER_TASK = 64;
+
+// Work-stealing thread pool.
+// Every participant (the thread that created the pool plus numThreads - 1 workers) owns a task deque.
+// Owners pop from the back of their own deque and idle participants steal from the front of others,
+// so uneven tasks still balance. A thread waiting on parallelFor keeps running tasks instead of blocking,
+// which lets a task start a nested parallelFor without adding threads.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t numThreads) : queues(max<size_t>(numThreads, 1)) {
+        for (auto& queue : queues) queue = make_unique<TaskQueue>();
+        participantIndex() = 0; // The creating thread is participant 0
+        for (size_t i = 1; i < queues.size(); ++i) {
+            workers.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> guard(sleepLock);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads that execute tasks, including the creating thread
+    size_t size() const { return queues.size(); }
+
+    // Runs body(i) for every i in [0, count), `grainSize` indices per task, and returns when all have finished.
+    // The calling thread helps execute tasks while it waits.
+    void parallelFor(size_t count, const function<void(size_t)>& body, size_t grainSize = 1) {
+        parallelForRange(count, grainSize, [&body](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) body(i);
+        });
+    }
+
+    // Splits [0, count) into chunks of `grainSize` and runs body(begin, end) once per chunk.
+    // Useful when a task needs its own scratch space or partial result.
+    void parallelForRange(size_t count, size_t grainSize, const function<void(size_t, size_t)>& body) {
+        if (count == 0) return;
+        grainSize = max<size_t>(grainSize, 1);
+        size_t numTasks = (count + grainSize - 1) / grainSize;
+        if (queues.size() == 1 || numTasks == 1) { // Nothing to share the work with
+            body(0, count);
+            return;
+        }
+
+        auto remaining = make_shared<atomic<size_t>>(numTasks);
+        int self = participantIndex();
+        size_t home = self >= 0 ? static_cast<size_t>(self) : 0;
+        pendingTasks.fetch_add(numTasks, memory_order_release); // Counted before pushing so it never underflows
+
+        // Deal the chunks round-robin starting with our own deque, so every idle participant has something nearby
+        for (size_t t = 0; t < numTasks; ++t) {
+            size_t begin = t * grainSize;
+            size_t end = min(count, begin + grainSize);
+            TaskQueue& queue = *queues[(home + t) % queues.size()];
+            lock_guard<mutex> guard(queue.lock);
+            queue.tasks.push_back([&body, begin, end, remaining] {
+                body(begin, end);
+                remaining->fetch_sub(1, memory_order_acq_rel);
+            });
+        }
+        {
+            lock_guard<mutex> guard(sleepLock); // Pairs with the wait in workerLoop so the wakeup cannot be lost
+        }
+        wakeUp.notify_all();
+
+        // Keep executing tasks (ours or stolen) until our chunks are done; a nested call from inside a task
+        // therefore reuses the pool's threads instead of oversubscribing the machine
+        while (remaining->load(memory_order_acquire) > 0) {
+            if (!runOneTask(home)) this_thread::yield();
+        }
+    }
+
+    // Counts the indices in [0, count) for which test(i) is true. Each chunk keeps its own count and
+    // the partial counts are summed at the end, so no shared counter is touched in the loop.
+    size_t parallelCount(size_t count, const function<bool(size_t)>& test, size_t grainSize) {
+        grainSize = max<size_t>(grainSize, 1);
+        size_t numChunks = (count + grainSize - 1) / grainSize;
+        vector<size_t> chunkCounts(numChunks, 0);
+        parallelForRange(count, grainSize, [&](size_t begin, size_t end) {
+            size_t local = 0;
+            for (size_t i = begin; i < end; ++i) {
+                if (test(i)) ++local;
+            }
+            chunkCounts[begin / grainSize] = local;
+        });
+
+        size_t total = 0;
+        for (size_t chunkCount : chunkCounts) total += chunkCount;
+        return total;
+    }
+
+private:
+    struct TaskQueue {
+        mutex lock;
+        deque<function<void()>> tasks;
+    };
+
+    vector<unique_ptr<TaskQueue>> queues;
+    vector<thread> workers;
+    atomic<size_t> pendingTasks{0};
+    mutex sleepLock;
+    condition_variable wakeUp;
+    bool stopping = false;
+
+    // Participant index of the current thread, or -1 for threads that do not belong to the pool
+    static int& participantIndex() {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    // Pops from our own deque first, then tries to steal from the others. Returns false if nothing ran.
+    bool runOneTask(size_t home) {
+        function<void()> task;
+        for (size_t offset = 0; offset < queues.size() && !task; ++offset) {
+            TaskQueue& queue = *queues[(home + offset) % queues.size()];
+            lock_guard<mutex> guard(queue.lock);
+            if (queue.tasks.empty()) continue;
+            if (offset == 0) { // Own deque: newest task first
+                task = move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else { // Steal the oldest task
+                task = move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+        }
+        if (!task) return false;
+        pendingTasks.fetch_sub(1, memory_order_acq_rel);
+        task();
+        return true;
+    }
+
+    void workerLoop(size_t index) {
+        participantIndex() = static_cast<int>(index);
+        while (true) {
+            if (runOneTask(index)) continue;
+
+            unique_lock<mutex> guard(sleepLock);
+            wakeUp.wait(guard, [this] { return stopping || pendingTasks.load(memory_order_acquire) > 0; });
+            if (stopping) return;
+        }
+    }
+};